@@ -0,0 +1,92 @@
+/*
+ * MIPS atomic operations, using LL/SC. See <atomic.h>.
+ */
+
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+#include <cdefs.h>
+
+int atomic_cas(volatile int *p, int old, int new);
+int atomic_fetchadd(volatile int *p, int delta);
+int atomic_swap(volatile int *p, int val);
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Each of these loads the word with LL, works out the new value, and
+ * tries to store it with SC. SC fails (leaving 0 in its register) if
+ * anyone else wrote the word in between, or if we took an interrupt;
+ * then we go round again.
+ */
+
+ATOMIC_INLINE
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   give up if x != old */
+		"move %1, %4;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+ATOMIC_INLINE
+int
+atomic_fetchadd(volatile int *p, int delta)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return x;
+}
+
+ATOMIC_INLINE
+int
+atomic_swap(volatile int *p, int val)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = val */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (val)
+		: "memory");
+	return x;
+}
+
+
+#endif /* _MIPS_ATOMIC_H_ */
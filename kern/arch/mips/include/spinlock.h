@@ -43,6 +43,7 @@ typedef unsigned spinlock_data_t;
 void spinlock_data_set(volatile spinlock_data_t *sd, unsigned val);
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+spinlock_data_t spinlock_data_fetchinc(volatile spinlock_data_t *sd);
 
 ////////////////////////////////////////////////////////////
 
@@ -93,5 +94,32 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_fetchinc(volatile spinlock_data_t *sd)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Atomic increment using LL/SC; returns the old value.
+	 *
+	 * Unlike testandset, this can't report failure, so retry
+	 * until the SC succeeds.
+	 */
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *sd */
+		"addiu %1, %0, 1;"	/*   y = x + 1 */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd) : "memory");
+	return x;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
@@ -133,6 +133,9 @@ syscall(struct trapframe *tf)
 	case SYS_fork:
 	  err = sys_fork(tf, (pid_t *)&retval);
 	  break;
+	case SYS_vfork:
+	  err = sys_vfork(tf, (pid_t *)&retval);
+	  break;
 	case SYS_execv:
 	  err = sys_execv((char *)tf->tf_a0, (char **)tf->tf_a1);
 	  break;	  
@@ -142,6 +145,32 @@ syscall(struct trapframe *tf)
 
 #endif // UW
 
+	    case SYS_setshare:
+		err = sys_setshare((int)tf->tf_a0);
+		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setaffinity:
+		err = sys_setaffinity((uint32_t)tf->tf_a0);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+				     (int *)&retval);
+		break;
+
 	    /* Add stuff here */
  
 	default:
@@ -191,6 +220,7 @@ void
 enter_forked_process(struct trapframe *tf)
 {
 	struct trapframe fork_tf = *tf;
+	kfree(tf);
 	fork_tf.tf_v0 = 0;
 	fork_tf.tf_a3 = 0;
 	fork_tf.tf_epc += 4;
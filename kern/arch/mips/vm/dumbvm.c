@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
@@ -37,6 +38,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <clock.h>
 #include "opt-A3.h"
 
 /*
@@ -55,7 +57,9 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
+	/* The stack must stay clear of the time page (see vm_fault). */
+	COMPILE_ASSERT(USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE >=
+		       TIMEPAGE_VADDR + PAGE_SIZE);
 }
 
 static
@@ -114,11 +118,17 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	uint32_t ehi, elo;
 	struct addrspace *as;
 	int spl;
+	bool readonly = false;
 
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
 
+	/* The shared time page is read-only. */
+	if (faultaddress == TIMEPAGE_VADDR && faulttype != VM_FAULT_READ) {
+		return EFAULT;
+	}
+
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
 	    #if OPT_A3
@@ -181,6 +191,11 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == TIMEPAGE_VADDR) {
+		/* Shared by everyone; see <kern/time.h>. */
+		paddr = clock_timepage() - MIPS_KSEG0;
+		readonly = true;
+	}
 	else {
 		return EFAULT;
 	}
@@ -203,6 +218,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 				elo &= ~TLBLO_DIRTY;
 			}
 		#endif
+		if (readonly) {
+			elo &= ~TLBLO_DIRTY;
+		}
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -215,6 +233,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		if(as->loaded && faultaddress >= vbase1 && faultaddress < vtop1) {
 			elo &= ~TLBLO_DIRTY;
 		} 
+		if (readonly) {
+			elo &= ~TLBLO_DIRTY;
+		}
 		tlb_random(ehi, elo);
 		splx(spl);
 		return 0;
@@ -297,6 +318,11 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 	npages = sz / PAGE_SIZE;
 
+	/* The time page's address is reserved; see <kern/time.h>. */
+	if (vaddr <= TIMEPAGE_VADDR && TIMEPAGE_VADDR - vaddr < sz) {
+		return EINVAL;
+	}
+
 	#if OPT_A3
 		as->readable = readable ? true : false;
 		as->writeable = writeable ? true : false; 
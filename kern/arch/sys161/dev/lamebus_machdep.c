@@ -73,6 +73,28 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read c0_count. Because writing c0_compare also restarts the count
+ * from zero (which is what lets mips_timer_set above schedule the
+ * next tick relative to now), this is the number of cycles since the
+ * timer was last set.
+ */
+static
+uint32_t
+mips_timer_get(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -116,6 +138,60 @@ mainbus_bootstrap(void)
 	mips_timer_set(CPU_FREQUENCY / HZ);
 }
 
+/*
+ * Tickless idle: switch the current cpu's timer off while it idles,
+ * then back on afterwards, returning how many ticks were skipped.
+ *
+ * "Off" is really as far away as the timer will go, which at 25 MHz
+ * is a bit under three minutes; if that does expire, hardclock runs
+ * once and the count restarts, so the tick count returned afterwards
+ * comes out low. Nothing depends on it being exact.
+ *
+ * Interrupts should be off.
+ */
+void
+mainbus_hardclock_stop(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+	mips_timer_set(0xffffffff);
+}
+
+unsigned
+mainbus_hardclock_start(void)
+{
+	uint32_t elapsed;
+
+	KASSERT(curthread->t_curspl > 0);
+	elapsed = mips_timer_get();
+	mips_timer_set(CPU_FREQUENCY / HZ);
+	return elapsed / (CPU_FREQUENCY / HZ);
+}
+
+/*
+ * Cycle counter: the hardclocks so far plus how far into the current
+ * one we are. Since hardclock rearms the timer a little after it
+ * fires, this can step back by a few cycles just after a tick;
+ * callers have to put up with that.
+ */
+uint32_t
+mainbus_cycles(void)
+{
+	uint32_t cycles;
+	int s;
+
+	s = splhigh();
+	cycles = curcpu->c_hardclocks * (CPU_FREQUENCY / HZ) +
+		mips_timer_get();
+	splx(s);
+	return cycles;
+}
+
+unsigned
+mainbus_cycles_per_ms(void)
+{
+	return CPU_FREQUENCY / 1000;
+}
+
 /*
  * Start all secondary CPUs.
  */
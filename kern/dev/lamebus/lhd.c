@@ -289,8 +289,11 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
+	/*
+	 * Create the semaphores. lh_clear is FIFO so that requests get
+	 * the disk in the order they asked for it.
+	 */
+	lh->lh_clear = sem_create_fifo("lhd-clear", 1);
 	if (lh->lh_clear == NULL) {
 		return ENOMEM;
 	}
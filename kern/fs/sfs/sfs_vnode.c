@@ -37,6 +37,7 @@
 #include <kern/fcntl.h>
 #include <stat.h>
 #include <lib.h>
+#include <atomic.h>
 #include <array.h>
 #include <bitmap.h>
 #include <uio.h>
@@ -904,7 +905,7 @@ sfs_reclaim(struct vnode *v)
 
 		/* consume the reference VOP_DECREF gave us */
 		KASSERT(v->vn_refcount>1);
-		v->vn_refcount--;
+		atomic_fetchadd(&v->vn_refcount, -1);
 
 		vfs_biglock_release();
 		return EBUSY;
@@ -0,0 +1,35 @@
+/*
+ * Atomic operations on 32-bit words.
+ */
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * These are for counters and reference counts that are updated often
+ * and by many threads, where taking a lock around every increment
+ * would cost far more than the increment. They don't disable
+ * interrupts and never spin for long, so they're safe to use
+ * anywhere, including in interrupt handlers and with spinlocks held.
+ *
+ * atomic_cas	   If *P is OLD, set it to NEW. Returns the value *P had
+ *		   before, so the store happened iff that equals OLD.
+ * atomic_fetchadd Add DELTA to *P. Returns the value *P had before.
+ * atomic_swap	   Set *P to VAL. Returns the value *P had before.
+ *
+ * Plain loads and stores of an int are already atomic; use those to
+ * read a counter.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+/* Get the machine-dependent bits. */
+#include <machine/atomic.h>
+
+
+#endif /* _ATOMIC_H_ */
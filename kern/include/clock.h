@@ -38,10 +38,13 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once a second. It resets
+ * fast_gettime's time from the clock; for timed sleeps see
+ * thread_sleep_ticks().
  *
  * gettime() may be used to fetch the current time of day.
+ * fast_gettime() is the same but only accurate to about a hardclock;
+ * it's much cheaper, as it doesn't touch the clock device.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -62,6 +65,25 @@ void hardclock(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+void fast_gettime(time_t *seconds, uint32_t *nanoseconds);
+
+/*
+ * Refresh fast_gettime's time from the clock device. Call at splhigh.
+ * timebase_idle is for a cpu about to stop its hardclock, so it stops
+ * being the one that advances the time each tick. timebase_get reads
+ * fast_gettime's time but never the clock device, so it's safe
+ * anywhere; it returns false (early in boot) if there isn't one yet.
+ */
+void timebase_update(void);
+void timebase_idle(void);
+bool timebase_get(time_t *seconds, uint32_t *nanoseconds);
+
+/*
+ * The page of the time fast_gettime uses, which the VM system maps
+ * read-only into every process at TIMEPAGE_VADDR (see <kern/time.h>).
+ * Returns its kernel virtual address.
+ */
+vaddr_t clock_timepage(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
@@ -34,8 +34,24 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <lockstat.h>
 
 
+/*
+ * Number of scheduler priority levels. Each cpu has one run queue per
+ * level; level 0 is the most urgent. See schedule() in thread.c.
+ */
+#define SCHED_NLEVELS	4
+
+/*
+ * Geometry of the per-cpu timer wheel used for timed sleeps. There
+ * are TIMER_LEVELS wheels of TIMER_SLOTS slots each; a slot at level
+ * N covers TIMER_SLOTS^N hardclocks. See "Timed sleep" in thread.c.
+ */
+#define TIMER_LEVELS	3
+#define TIMER_SLOTBITS	6
+#define TIMER_SLOTS	(1U << TIMER_SLOTBITS)
+
 /*
  * Per-cpu structure
  *
@@ -51,7 +67,7 @@ struct cpu {
 	 * Fixed after allocation.
 	 */
 	struct cpu *c_self;		/* Canonical address of this struct */
-	unsigned c_number;		/* This cpu's cpu number */
+	unsigned c_number;		/* This cpu's cpu number (< 32) */
 	unsigned c_hardware_number;	/* Hardware-defined cpu number */
 
 	/*
@@ -59,16 +75,39 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_pushes;		/* Threads migrated away by this cpu */
+	unsigned c_steals;		/* Threads stolen by this cpu */
+	unsigned c_busyticks;		/* Hardclocks spent running threads */
+	unsigned c_idleticks;		/* Hardclocks spent idle */
+	unsigned c_switches;		/* Context switches */
+	struct thread *c_handoff;	/* Ready thread to send elsewhere */
+#if OPT_LOCKSTAT
+	struct lockstat c_lockstat[LOCKSTAT_SLOTS]; /* Lock statistics */
+	unsigned c_lockstat_dropped;	/* Records with no room */
+#endif
 
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[SCHED_NLEVELS]; /* Run queues, by priority */
+	struct threadlist c_sharequeue;	/* Proportional-share threads */
+	unsigned c_ts_pass;		/* Stride pass of timesharing class */
+	unsigned c_sched_vtime;		/* Pass of last thread picked */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Accessed only by this cpu, but also from its timer
+	 * interrupt. Protected by the timer lock.
+	 */
+	struct threadlist c_timers[TIMER_LEVELS][TIMER_SLOTS];
+	unsigned c_timer_now;		/* Wheel time, in hardclocks */
+	unsigned c_timer_count;		/* Threads on the wheel */
+	struct spinlock c_timer_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -51,6 +51,28 @@ struct timespec {
 };
 
 
+/*
+ * The shared time page. The kernel maps this page read-only into
+ * every process at TIMEPAGE_VADDR and keeps the time in it current to
+ * within a clock tick, so reading the time needs no system call.
+ *
+ * The page's address is reserved in every address space: the VM
+ * system refuses to define a region over it and keeps the stack clear
+ * of it.
+ *
+ * tp_seq is odd while the kernel is updating the page. To read it,
+ * take tp_seq, copy the time, and start over if tp_seq was odd or
+ * has since changed.
+ */
+#define TIMEPAGE_VADDR	0x7ff00000
+
+struct timepage {
+	volatile __u32 tp_seq;		/* update sequence number */
+	volatile __time_t tp_sec;	/* seconds */
+	volatile __u32 tp_nsec;		/* nanoseconds */
+};
+
+
 /*
  * Bits for interval timers. Obscure and not really that important.
  */
@@ -0,0 +1,101 @@
+/*
+ * Lock contention statistics ("lockstat").
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+#include "opt-lockstat.h"
+
+/*
+ * With "options lockstat" in the kernel config, lock_acquire and P
+ * record for every lock how often it was taken, how often the taker
+ * had to wait, how long it waited in total and at worst, and (for
+ * locks) how long it was then held. spinlock_acquire records its
+ * contended acquisitions the same way.
+ *
+ * Each cpu records into its own table in struct cpu, so recording
+ * needs no locking. Entries are keyed by name, so all the locks called
+ * "vnode-lock" (say) are counted together. Spinlocks have no name and
+ * are keyed by address instead.
+ *
+ * Without the option the hooks compile to nothing.
+ */
+
+/*
+ * When a wait or hold began. The cycle counter is only good on the
+ * cpu that read it (see mainbus_cycles), and a thread can move while
+ * it waits for or holds a sleep lock, so the time base (good to a
+ * tick or so) is kept as well, for when it ends on another cpu.
+ *
+ * This is declared either way so struct lock needn't depend on the
+ * option.
+ */
+struct lockstat_stamp {
+	uint32_t lss_cycles;		/* mainbus_cycles() */
+	unsigned lss_cpu;		/* ...on this cpu */
+	bool lss_havetime;		/* false if no time base yet */
+	time_t lss_secs;		/* fast_gettime() */
+	uint32_t lss_nsecs;
+};
+
+#if OPT_LOCKSTAT
+
+struct cpu;
+
+/* Entries in each cpu's table, and how much of a name is kept. */
+#define LOCKSTAT_SLOTS		64
+#define LOCKSTAT_NAMELEN	24
+
+/*
+ * One lock's record on one cpu. Times are kept as whole milliseconds
+ * plus leftover cycles, so they won't overflow in any reasonable run.
+ */
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];	/* Lock name ("" if spinlock) */
+	const void *ls_addr;		/* Spinlock address */
+	unsigned ls_acquires;		/* Times acquired */
+	unsigned ls_contended;		/* Times we had to wait */
+	unsigned ls_waitms;		/* Total wait, ms... */
+	unsigned ls_waitcycles;		/* ...plus cycles */
+	uint32_t ls_waitmax;		/* Longest wait, cycles */
+	unsigned ls_holdms;		/* Total hold time, ms... */
+	unsigned ls_holdcycles;		/* ...plus cycles */
+	unsigned ls_xcpu;		/* Waits and holds that moved cpus */
+};
+
+/*
+ * Functions.
+ *
+ * lockstat_cpu_init	Set up the table for a new cpu.
+ * lockstat_start	Stamp the start of a wait or hold.
+ * lockstat_acquired	Record that LOCK (called NAME, or NULL for a
+ *			spinlock) was acquired, after waiting since
+ *			START if CONTENDED.
+ * lockstat_released	Record that LOCK was released after being held
+ *			since START.
+ * lockstat_print	Print the NUM locks with the most total wait.
+ * lockstat_clear	Zero all the tables.
+ */
+void lockstat_cpu_init(struct cpu *c);
+void lockstat_start(struct lockstat_stamp *st);
+void lockstat_acquired(const void *lock, const char *name, bool contended,
+		       const struct lockstat_stamp *start);
+void lockstat_released(const void *lock, const char *name,
+		       const struct lockstat_stamp *start);
+void lockstat_print(unsigned num);
+void lockstat_clear(void);
+
+#else
+
+#define lockstat_cpu_init(c) ((void)(c))
+#define lockstat_start(st) ((void)(st))
+#define lockstat_acquired(lock, name, contended, start) \
+	((void)(lock), (void)(name), (void)(contended), (void)(start))
+#define lockstat_released(lock, name, start) \
+	((void)(lock), (void)(name), (void)(start))
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,21 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Stop and restart the current cpu's periodic timer around idling.
+ * The restart returns the number of hardclock ticks that were missed.
+ */
+void mainbus_hardclock_stop(void);
+unsigned mainbus_hardclock_start(void);
+
+/*
+ * Cheap fine-grained time on the current cpu: cycles since it booted
+ * (wrapping), and how many cycles there are in a millisecond. Only
+ * good for timing short intervals.
+ */
+uint32_t mainbus_cycles(void);
+unsigned mainbus_cycles_per_ms(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
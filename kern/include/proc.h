@@ -60,6 +60,16 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
+	/*
+	 * Proportional-share scheduling. p_share is 0 for ordinary
+	 * timesharing processes. p_pass is advanced by p_stride from
+	 * hardclock() and is protected by p_lock; the scheduler reads
+	 * it unlocked, which at worst makes one decision a bit unfair.
+	 */
+	unsigned p_share;		/* tickets; 0 = timesharing */
+	unsigned p_stride;		/* SCHED_STRIDE1 / p_share */
+	volatile unsigned p_pass;	/* virtual time consumed */
+
 #ifdef UW
   /* a vnode to refer to the console device */
   /* this is a quick-and-dirty way to get console writes working */
@@ -71,6 +81,12 @@ struct proc {
      #if OPT_A2
 		pid_t pid;
 		pid_t p_pid;
+		/*
+		 * Set in a vforked child until it execs or exits: the
+		 * address space is its parent's, and the parent is
+		 * waiting on this to get it back.
+		 */
+		struct semaphore *p_vfork_sem;
 	#else
 
 	#endif /* OPT_A2 */
@@ -78,6 +94,9 @@ struct proc {
 	/* add more material here as needed */
 };
 
+/* Largest share setshare() will accept. */
+#define SCHED_MAXSHARE	1000
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -87,21 +106,28 @@ extern struct semaphore *no_proc_sem;
 #endif // UW
 
 #if OPT_A2
+	/* size of the hash table of proc_status records */
+	#define PROC_HASH_SIZE 128
+
 	struct proc_status {
 		pid_t pid;
 		pid_t p_pid;
 		int exit_code;
 		int status;
+		struct proc_status *hashnext;	/* next in hash chain */
+		struct proc_status *children;	/* first child */
+		struct proc_status *sibling;	/* parent's next child */
+		struct proc_status **siblingprev;	/* what points to us */
+		struct wchan *waitchan;		/* for waiting for children */
 	};
-	struct array *all_procs;
-	struct lock *all_procs_lock;
-	struct cv *proc_cv;
+	struct rwlock *all_procs_rwlock;
 	pid_t generate_pid(void);
-	void new_proc_to_proc_array(pid_t pid, const char *name);
-	int proc_index_in_proc_array(pid_t pid);
+	void release_pid(pid_t pid);
+	int new_proc_status(pid_t pid);
+	void remove_proc_status(struct proc_status *curr);
 	struct proc_status* get_proc_status(pid_t pid);
 	void update_proc_parent_pid(pid_t pid, pid_t p_pid);
-	void orphan_children(pid_t pid);
+	void orphan_children(struct proc_status *parent);
 	void save_exit_code(pid_t pid, int exit_code);
 #else
 
@@ -53,16 +53,29 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * These are ticket locks: each cpu that wants the lock takes the next
+ * number from lk_next and waits for lk_serving to come round to it.
+ * So cpus get the lock in the order they asked for it, and nobody can
+ * be starved, however hot the lock is.
+ *
+ * lk_acquires and lk_contended count how often the lock was taken and
+ * how often of those the taker had to wait. They're only updated by
+ * the holder, so they need no atomic operations.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next;    /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket that holds the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+	unsigned lk_acquires;		/* Times acquired. */
+	unsigned lk_contended;		/* Times we had to wait. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, 0, 0 }
 
 /*
  * Spinlock functions.
@@ -74,6 +87,10 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ * is_held	Check, without locking, if any CPU holds the lock. The
+ *		answer may be out of date by the time it's returned.
+ *
+ * printstats	Print lk_acquires and lk_contended, labeled NAME.
  */
 
 void spinlock_init(struct spinlock *lk);
@@ -83,6 +100,8 @@ void spinlock_acquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
+bool spinlock_is_held(struct spinlock *lk);
+void spinlock_printstats(const char *name, struct spinlock *lk);
 
 
 #endif /* _SPINLOCK_H_ */
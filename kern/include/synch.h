@@ -36,21 +36,31 @@
 
 
 #include <spinlock.h>
+#include <lockstat.h>
 
 /*
  * Dijkstra-style semaphore.
  *
  * The name field is for easier debugging. A copy of the name is made
  * internally.
+ *
+ * A semaphore made with sem_create_fifo is strictly first come first
+ * served: V gives the unit straight to the thread that has been
+ * waiting longest, rather than bumping the count and letting whoever
+ * gets there first take it. sem_waiters counts the threads waiting
+ * for such a handoff.
  */
 struct semaphore {
         char *sem_name;
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+        bool sem_fifo;
+        unsigned sem_waiters;
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
+struct semaphore *sem_create_fifo(const char *name, int initial_count);
 void sem_destroy(struct semaphore *);
 
 /*
@@ -71,13 +81,19 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * A thread that finds the lock held spins for a while before going to
+ * sleep, as long as the holder is running on another cpu and so is
+ * likely to let go soon; lock_holder_cpu is for checking that.
  */
 struct lock {
         char *lk_name;
         struct wchan *lock_wchan;
         struct spinlock lock_lock;
         volatile bool locked;
-        struct thread *lock_holder;
+        struct thread * volatile lock_holder;
+        struct cpu * volatile lock_holder_cpu;
+        struct lockstat_stamp lock_acqstamp; /* When taken, for lockstat */
 };
 
 struct lock *lock_create(const char *name);
@@ -115,8 +131,6 @@ void lock_destroy(struct lock *);
 
 struct cv {
         char *cv_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
         struct wchan *cv_wchan;
 };
 
@@ -134,11 +148,63 @@ void cv_destroy(struct cv *);
  * in. Note that under normal circumstances the same lock should be used
  * on all operations with any particular CV.
  *
- * These operations must be atomic. You get to write them.
+ * cv_broadcast doesn't actually wake anyone: the waiters are moved
+ * onto the lock's wait queue, and lock_release wakes them one at a
+ * time as the lock becomes free ("wait morphing").
  */
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * With WRITERPREF set at creation, new readers wait while a writer is
+ * waiting, so writers can't be starved; without it, readers keep
+ * getting in as long as any reader holds the lock, which is better for
+ * throughput but can starve writers.
+ *
+ * rw_state holds the reader count and two flags (RW_WRITER when a
+ * writer holds the lock, RW_WWAIT when writers are waiting) and is
+ * updated with atomic operations. A reader that finds no flag in its
+ * way (RW_WRITER, or RW_WWAIT under writer preference) just counts
+ * itself in and out, without touching rw_lock. Everything else goes
+ * through rw_lock.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+	char *rw_name;
+	struct wchan *rw_readwchan;	/* Readers wait here */
+	struct wchan *rw_writewchan;	/* Writers wait here */
+	struct spinlock rw_lock;	/* Protects the rest */
+	volatile int rw_state;		/* Readers, plus flags below */
+	unsigned rw_writerswaiting;	/* Writers waiting for it */
+	struct thread *rw_writer;	/* Writer holding the lock */
+	bool rw_writerpref;
+};
+
+struct rwlock *rwlock_create(const char *name, bool writerpref);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusively).
+ *    rwlock_release_write - Give up a write hold.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                   the lock for writing. (Read holds aren't tracked
+ *                   by thread.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
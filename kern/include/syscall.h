@@ -62,6 +62,7 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 #ifdef UW
 #if OPT_A2
 	int sys_fork(struct trapframe *tf, pid_t *retval);
+	int sys_vfork(struct trapframe *tf, pid_t *retval);
 #else
 
 #endif /* OPT_A2 */
@@ -72,4 +73,14 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 int sys_execv(char *program, char **args);
 #endif // UW
 
+int sys_setshare(int share);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
+int sys_getrusage(int who, userptr_t usage);
+int sys_setaffinity(uint32_t mask);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int num, int *retval);
+
+/* Set up the futex wait table, at boot. */
+void futex_bootstrap(void);
+
 #endif /* _SYSCALL_H_ */
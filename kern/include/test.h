@@ -57,9 +57,27 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
+int threadtest5(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int rwtest(int, char **);
+
+/*
+ * Benchmark timing for the tests above. bench_start records the time;
+ * bench_stop replaces it with the time elapsed since. bench_report
+ * prints "COUNT WHAT in S seconds (U us each)".
+ */
+struct benchtime {
+	time_t bt_secs;
+	uint32_t bt_nsecs;
+};
+void bench_start(struct benchtime *bt);
+void bench_stop(struct benchtime *bt);
+unsigned long bench_usecs(const struct benchtime *bt);
+void bench_report(const struct benchtime *bt, unsigned count,
+		  const char *what);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -84,6 +84,31 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduler fields.
+	 *
+	 * While the thread is on a run queue these are protected by
+	 * that cpu's run queue lock; otherwise only the thread itself
+	 * (or the timer interrupt on its cpu) touches them.
+	 */
+	unsigned t_priority;		/* Run queue level; 0 is highest */
+	unsigned t_quantum;		/* Hardclocks left in current slice */
+	unsigned t_readysince;		/* c_hardclocks when last queued */
+	unsigned t_movedat;		/* c_hardclocks when last migrated */
+	struct cpu *t_lastcpu;		/* CPU thread last ran on */
+	unsigned t_lastrun;		/* c_hardclocks when it last ran */
+	uint32_t t_affinity;		/* CPUs it may run on, by c_number */
+	unsigned t_wakeat;		/* c_timer_now to wake at, if timed */
+
+	/*
+	 * Accounting. Times are in hardclocks. Only the thread's own
+	 * cpu updates these, with interrupts off.
+	 */
+	unsigned t_runticks;		/* Time spent running */
+	unsigned t_waitticks;		/* Time spent on a run queue */
+	unsigned t_nvcsw;		/* Voluntary context switches */
+	unsigned t_nivcsw;		/* Involuntary context switches */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -157,6 +182,22 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for one hardclock. Returns true if it
+ * should give up the processor, either because its quantum ran out
+ * or because a higher-priority thread is waiting. Called from the
+ * timer interrupt.
+ */
+bool thread_tick(void);
+
+/*
+ * Put a process in the proportional-share scheduling class with
+ * SHARE tickets, or back into ordinary timesharing if SHARE is 0.
+ * The process's threads must not be on a run queue, which in practice
+ * means PROC must be the current process.
+ */
+void thread_setshare(struct proc *proc, unsigned share);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -168,5 +209,39 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Restrict the current thread to the cpus in MASK (bit N is the cpu
+ * whose c_number is N). Threads it forks afterwards inherit the mask.
+ * Returns EINVAL if MASK names no cpu that exists. If we're on a cpu
+ * outside the mask we move off it before returning.
+ */
+int thread_setaffinity(uint32_t mask);
+
+/*
+ * Set how many exited threads each cpu keeps for thread_fork to
+ * reuse; 0 turns recycling off. Returns the old limit. For the
+ * fork/exit benchmark.
+ */
+unsigned thread_set_poolmax(unsigned max);
+
+/*
+ * Print per-cpu migration counts and the recent migration rate.
+ */
+void thread_migration_stats(void);
+
+/*
+ * Sleep for at least TICKS hardclocks. thread_timer_tick runs the
+ * current cpu's timer wheel and wakes whoever is due; it is called
+ * from the timer interrupt.
+ */
+void thread_sleep_ticks(unsigned ticks);
+void thread_timer_tick(void);
+
+/*
+ * Print per-cpu busy/idle time and switch counts, and the accounting
+ * for each thread that is running or waiting to run.
+ */
+void thread_sched_stats(void);
+
 
 #endif /* _THREAD_H_ */
@@ -49,8 +49,8 @@ void _vmstats_init(void);                    /* atomicity must be ensured elsewh
  *   vmstats_inc(VMSTAT_TLB_FAULT);
  *   vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
  */
-void vmstats_inc(unsigned int index);    /* uses locking */
-void _vmstats_inc(unsigned int index);   /* atomicity must be ensured elsewhere */
+void vmstats_inc(unsigned int index);    /* atomic */
+void _vmstats_inc(unsigned int index);   /* also atomic; same as vmstats_inc */
 
 /* Print the statistics: assumes that at least vmstats_init has been called */
 void vmstats_print(void);                    /* Does NOT use locking */
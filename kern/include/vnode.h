@@ -50,9 +50,12 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * vn_refcount is updated with atomic operations (see vnode_incref);
+ * the vfs biglock is only needed to take it to or from zero.
  */
 struct vnode {
-	int vn_refcount;                /* Reference count */
+	volatile int vn_refcount;       /* Reference count */
 	int vn_opencount;
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
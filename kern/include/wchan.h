@@ -81,5 +81,11 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Move all threads sleeping on FROM to TO, without waking them. FROM
+ * must be locked; TO should not be.
+ */
+void wchan_moveall(struct wchan *from, struct wchan *to);
+
 
 #endif /* _WCHAN_H_ */
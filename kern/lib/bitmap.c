@@ -131,6 +131,46 @@ bitmap_translate(unsigned bitno, unsigned *ix, WORD_TYPE *mask)
         *mask = ((WORD_TYPE)1) << offset;
 }
 
+/*
+ * Like bitmap_alloc, but start looking at bit START instead of bit 0,
+ * wrapping around at the end. Called with a hint that moves along,
+ * this hands bits out in rotation and doesn't rescan the bits already
+ * in use at the front every time.
+ */
+int
+bitmap_alloc_from(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned ix, bitno, seen, step;
+        WORD_TYPE mask;
+
+        KASSERT(start < b->nbits);
+
+        bitno = start;
+        for (seen = 0; seen < b->nbits; seen += step) {
+                bitmap_translate(bitno, &ix, &mask);
+                if (b->v[ix] == WORD_ALLBITS) {
+                        /* skip the rest of this word */
+                        step = BITS_PER_WORD - bitno % BITS_PER_WORD;
+                        if (step > b->nbits - bitno) {
+                                step = b->nbits - bitno;
+                        }
+                }
+                else if ((b->v[ix] & mask) == 0) {
+                        b->v[ix] |= mask;
+                        *index = bitno;
+                        return 0;
+                }
+                else {
+                        step = 1;
+                }
+                bitno += step;
+                if (bitno == b->nbits) {
+                        bitno = 0;
+                }
+        }
+        return ENOSPC;
+}
+
 void
 bitmap_mark(struct bitmap *b, unsigned index)
 {
@@ -49,6 +49,9 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <wchan.h>
+#include <atomic.h>
+#include <bitmap.h>
 #include <kern/fcntl.h>  
 #include <limits.h>
 #include <kern/errno.h>
@@ -64,14 +67,18 @@ struct proc *kproc;
  */
 #ifdef UW
 /* count of the number of processes, excluding kproc */
-static volatile unsigned int proc_count;
-/* provides mutual exclusion for proc_count */
-/* it would be better to use a lock here, but we use a semaphore because locks are not implemented in the base kernel */ 
-static struct semaphore *proc_count_mutex;
+/* updated with atomic operations, so it needs no lock */
+static volatile int proc_count;
 /* used to signal the kernel menu thread when there are no processes */
 struct semaphore *no_proc_sem;   
 #if OPT_A2
-	static pid_t curr_pid = PID_MIN;
+	/* how many released PIDs are held back before reuse */
+	#define PID_QUARANTINE 64
+
+	static struct bitmap *pid_map;		/* PIDs in use or quarantined */
+	static unsigned pid_hint;		/* where the next search starts */
+	static pid_t pid_quarantine[PID_QUARANTINE];	/* FIFO ring */
+	static unsigned pid_qhead, pid_qcount;
 	static struct lock *pid_lock;
 #else
 
@@ -79,78 +86,199 @@ struct semaphore *no_proc_sem;
 #endif  // UW
 
 #if OPT_A2
+/*
+ * PIDs come from a bitmap of the ones taken. Each search starts just
+ * past the last PID handed out, so PIDs go round in order and the
+ * next bit is nearly always free; an allocation only has to scan when
+ * it runs into a stretch of long-lived processes.
+ *
+ * A PID given back by release_pid stays marked in the bitmap, waiting
+ * in a FIFO quarantine until PID_QUARANTINE more PIDs have been given
+ * back. That way a reaped PID doesn't turn up again on the very next
+ * fork even when most PIDs are taken. If the bitmap is full the
+ * oldest quarantined PID is used anyway, rather than failing.
+ *
+ * Call with pid_lock held (except for kproc, made before the lock).
+ * Returns -1 if every PID is in use.
+ */
 pid_t generate_pid(void) {
-	if(curr_pid <= PID_MAX) {
-		int result = curr_pid;
-		curr_pid++;
-		return result;
-	} else {
-		return ENPROC;
+	unsigned index;
+
+	if(bitmap_alloc_from(pid_map, pid_hint, &index)) {
+		if(pid_qcount == 0) {
+			return -1;
+		}
+		/* still marked in the bitmap; just take it out of the queue */
+		index = pid_quarantine[pid_qhead];
+		pid_qhead = (pid_qhead + 1) % PID_QUARANTINE;
+		pid_qcount--;
 	}
+	pid_hint = (index + 1) % (PID_MAX + 1);
+	return index;
+}
+
+void release_pid(pid_t pid) {
+	lock_acquire(pid_lock);
+	if(pid_qcount == PID_QUARANTINE) {
+		bitmap_unmark(pid_map, pid_quarantine[pid_qhead]);
+		pid_qhead = (pid_qhead + 1) % PID_QUARANTINE;
+		pid_qcount--;
+	}
+	pid_quarantine[(pid_qhead + pid_qcount) % PID_QUARANTINE] = pid;
+	pid_qcount++;
+	lock_release(pid_lock);
+}
+
+/*
+ * Status records are kept in a hash table indexed by PID, and each one
+ * is also on its parent's list of children. So finding a record, and
+ * finding all of a process's children, don't have to search through
+ * every process in the system.
+ *
+ * A record goes away, and its PID is released, once the process has
+ * exited and nobody can wait for it any more: when its parent reaps
+ * it, or right away if it has no parent or its parent exits first.
+ *
+ * A parent in waitpid sleeps on its own record's waitchan, and an
+ * exiting child wakes just that, so an exit only disturbs the one
+ * process that might care about it.
+ *
+ * All of this is protected by all_procs_rwlock. Most waitpid calls
+ * only look things up, and do it holding the lock for reading; adding
+ * and removing records and recording exits need it for writing.
+ */
+static struct proc_status *proc_table[PROC_HASH_SIZE];
+
+static
+unsigned
+proc_hash(pid_t pid) {
+	return (unsigned)pid % PROC_HASH_SIZE;
 }
 
-void new_proc_to_proc_array(pid_t pid, const char *name) {
+int new_proc_status(pid_t pid) {
 	struct proc_status* curr = kmalloc(sizeof(struct proc_status));
+	if(curr == NULL) {
+		return ENOMEM;
+	}
+	curr->waitchan = wchan_create("waitpid");
+	if(curr->waitchan == NULL) {
+		kfree(curr);
+		return ENOMEM;
+	}
 	curr->pid = pid;
 	curr->p_pid = -1;
 	curr->status = 1;
-	if(name == "[kernel]") {
-		array_add(all_procs, curr, NULL);
-	} else {
-		lock_acquire(all_procs_lock);
-		array_add(all_procs, curr, NULL);
-		lock_release(all_procs_lock);
+	curr->children = NULL;
+	curr->sibling = NULL;
+	curr->siblingprev = NULL;
+	/* kproc is made before the lock */
+	if(kproc != NULL) {
+		rwlock_acquire_write(all_procs_rwlock);
 	}
-	return;
+	curr->hashnext = proc_table[proc_hash(pid)];
+	proc_table[proc_hash(pid)] = curr;
+	if(kproc != NULL) {
+		rwlock_release_write(all_procs_rwlock);
+	}
+	return 0;
 }
 
-int proc_index_in_proc_array(pid_t pid) {
-	for(unsigned int x = 0; x < array_num(all_procs); x++) {
-		struct proc_status *curr = array_get(all_procs, x);
+// Assumes lock already is acquired
+struct proc_status* get_proc_status(pid_t pid) {
+	struct proc_status *curr;
+
+	curr = proc_table[proc_hash(pid)];
+	for(; curr != NULL; curr = curr->hashnext) {
 		if(curr->pid == pid) {
-			return x;
+			return curr;
 		}
 	}
-	return -1;
+	return NULL;
 }
 
-struct proc_status* get_proc_status(pid_t pid) {
-	int index = proc_index_in_proc_array(pid);
-	if(index == -1) {
-		return NULL;
-	} else {
-		return array_get(all_procs, index);
+// Assumes lock already is acquired
+static
+void
+unlink_from_parent(struct proc_status *curr) {
+	if(curr->siblingprev != NULL) {
+		*curr->siblingprev = curr->sibling;
+		if(curr->sibling != NULL) {
+			curr->sibling->siblingprev = curr->siblingprev;
+		}
+		curr->sibling = NULL;
+		curr->siblingprev = NULL;
+	}
+	curr->p_pid = -1;
+}
+
+// Assumes lock already is acquired
+// Drops an exited process's record once nobody can wait for it,
+// and frees its PID.
+void remove_proc_status(struct proc_status *curr) {
+	struct proc_status **pp;
+
+	KASSERT(curr->status == 0);
+	KASSERT(curr->children == NULL);
+	unlink_from_parent(curr);
+	pp = &proc_table[proc_hash(curr->pid)];
+	while(*pp != curr) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->hashnext;
 	}
+	*pp = curr->hashnext;
+	release_pid(curr->pid);
+	wchan_destroy(curr->waitchan);
+	kfree(curr);
 }
 
 void update_proc_parent_pid(pid_t pid, pid_t p_pid) {
-	lock_acquire(all_procs_lock);
+	rwlock_acquire_write(all_procs_rwlock);
 	struct proc_status* curr = get_proc_status(pid);
-	curr->p_pid = p_pid;
-	lock_release(all_procs_lock);
+	unlink_from_parent(curr);
+	if(p_pid != -1) {
+		struct proc_status *parent = get_proc_status(p_pid);
+		KASSERT(parent != NULL);
+		curr->p_pid = p_pid;
+		curr->sibling = parent->children;
+		if(curr->sibling != NULL) {
+			curr->sibling->siblingprev = &curr->sibling;
+		}
+		curr->siblingprev = &parent->children;
+		parent->children = curr;
+	}
+	rwlock_release_write(all_procs_rwlock);
 	return;
 }
 
 // Assumes lock already is acquired
-void orphan_children(pid_t pid) {
-	for(unsigned int x = 0; x < array_num(all_procs); x++) {
-		struct proc_status *curr = array_get(all_procs, x);
-		if(curr->p_pid == pid) {
-			curr->p_pid = -1;
+void orphan_children(struct proc_status *parent) {
+	struct proc_status *curr;
+
+	while((curr = parent->children) != NULL) {
+		unlink_from_parent(curr);
+		if(curr->status == 0) {
+			/* already exited, and now nobody will wait for it */
+			remove_proc_status(curr);
 		}
 	}
 }
 
 void save_exit_code(pid_t pid, int exit_code) {
-	lock_acquire(all_procs_lock);
+	rwlock_acquire_write(all_procs_rwlock);
 	struct proc_status* curr = get_proc_status(pid);
 	curr->exit_code = _MKWAIT_EXIT(exit_code);
 	curr->status = 0;
+	orphan_children(curr);
 	if(curr->p_pid == -1) {
-		orphan_children(pid);
-		cv_broadcast(proc_cv, all_procs_lock);
+		/* no parent to collect the exit code; the PID can go */
+		remove_proc_status(curr);
+	} else {
+		/* wake our parent, if it's in waitpid, and nobody else */
+		struct proc_status *parent = get_proc_status(curr->p_pid);
+		KASSERT(parent != NULL);
+		wchan_wakeall(parent->waitchan);
 	}
-	lock_release(all_procs_lock);
+	rwlock_release_write(all_procs_rwlock);
 	return;
 }
 
@@ -187,6 +315,11 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+	/* Scheduling fields */
+	proc->p_share = 0;
+	proc->p_stride = 0;
+	proc->p_pass = 0;
+
 #ifdef UW
 	proc->console = NULL;
 	#if OPT_A2
@@ -197,8 +330,25 @@ proc_create(const char *name)
 			proc->pid = generate_pid();
 			lock_release(pid_lock);
 		}
+		if (proc->pid < 0) {
+			threadarray_cleanup(&proc->p_threads);
+			spinlock_cleanup(&proc->p_lock);
+			kfree(proc->p_name);
+			kfree(proc);
+			return NULL;
+		}
+		if (new_proc_status(proc->pid)) {
+			if (kproc != NULL) {
+				release_pid(proc->pid);
+			}
+			threadarray_cleanup(&proc->p_threads);
+			spinlock_cleanup(&proc->p_lock);
+			kfree(proc->p_name);
+			kfree(proc);
+			return NULL;
+		}
 		proc->p_pid = -1;
-		new_proc_to_proc_array(proc->pid, name);
+		proc->p_vfork_sem = NULL;
 	#else
 
 	#endif /* OPT_A2 */
@@ -214,6 +364,10 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+#ifdef UW
+	int old_count;
+#endif
+
 	/*
          * note: some parts of the process structure, such as the address space,
          *  are destroyed in sys_exit, before we get here
@@ -276,14 +430,12 @@ proc_destroy(struct proc *proc)
         /* note: kproc is not included in the process count, but proc_destroy
 	   is never called on kproc (see KASSERT above), so we're OK to decrement
 	   the proc_count unconditionally here */
-	P(proc_count_mutex); 
-	KASSERT(proc_count > 0);
-	proc_count--;
+	old_count = atomic_fetchadd(&proc_count, -1);
+	KASSERT(old_count > 0);
 	/* signal the kernel menu thread if the process count has reached zero */
-	if (proc_count == 0) {
+	if (old_count == 1) {
 	  V(no_proc_sem);
 	}
-	V(proc_count_mutex);
 #endif // UW
 	
 
@@ -296,8 +448,14 @@ void
 proc_bootstrap(void)
 {
 #if OPT_A2
-	all_procs = array_create(); // MUST be made before proc_create is called
-	array_init(all_procs);
+	pid_map = bitmap_create(PID_MAX + 1); // MUST be made before proc_create is called
+	if(pid_map == NULL) {
+		panic("Could not create pid map");
+	}
+	for(unsigned int x = 0; x < PID_MIN; x++) {
+		bitmap_mark(pid_map, x);
+	}
+	pid_hint = PID_MIN;
 #else
 #endif /* OPT_A2 */
 
@@ -307,10 +465,6 @@ proc_bootstrap(void)
   }
 #ifdef UW
   proc_count = 0;
-  proc_count_mutex = sem_create("proc_count_mutex",1);
-  if (proc_count_mutex == NULL) {
-    panic("could not create proc_count_mutex semaphore\n");
-  }
   no_proc_sem = sem_create("no_proc_sem",0);
   if (no_proc_sem == NULL) {
     panic("could not create no_proc_sem semaphore\n");
@@ -320,13 +474,9 @@ proc_bootstrap(void)
 		if(pid_lock == NULL) {
 			panic("Could not create pid lock");
 		}
-		all_procs_lock = lock_create("all_procs_lock");
-		if(all_procs_lock == NULL) {
-			panic("Could not create all_procs_lock");
-		}
-		proc_cv = cv_create("proc_cv");
-		if (proc_cv == NULL) {
-			panic("Could not create proc_cv");
+		all_procs_rwlock = rwlock_create("all_procs_rwlock", false);
+		if(all_procs_rwlock == NULL) {
+			panic("Could not create all_procs_rwlock");
 		}
 	#else
 
@@ -392,9 +542,7 @@ proc_create_runprogram(const char *name)
 	/* increment the count of processes */
         /* we are assuming that all procs, including those created by fork(),
            are created using a call to proc_create_runprogram  */
-	P(proc_count_mutex); 
-	proc_count++;
-	V(proc_count_mutex);
+	atomic_fetchadd(&proc_count, 1);
 #endif // UW
 
 	return proc;
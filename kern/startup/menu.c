@@ -42,6 +42,7 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -397,6 +398,55 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_sched_stats();
+
+	return 0;
+}
+
+static
+int
+cmd_migstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_migration_stats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing the most contended locks, or with "clear",
+ * starting the counts over.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [count | clear]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 2 && !strcmp(args[1], "clear")) {
+		lockstat_clear();
+	}
+	else {
+		lockstat_print(nargs == 2 ? atoi(args[1]) : 10);
+	}
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -460,12 +510,15 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork/exit benchmark    ",
+	"[tt5] Semaphore ping-pong benchmark ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
-	"[sy1] Semaphore test                ",
+	"[sy1] Semaphore test [bench]        ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[rw1] Reader-writer lock test       ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -506,6 +559,11 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[mig] Thread migration stats        ",
+	"[sched] Scheduler accounting        ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[dth] Enable DB_THREADS             ",
 	"[q] Quit and shut down              ",
 	NULL
@@ -575,6 +633,11 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "mig",        cmd_migstats },
+	{ "sched",      cmd_schedstats },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -587,11 +650,14 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
+	{ "tt5",	threadtest5 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "rw1",	rwtest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -643,16 +709,25 @@ cmd_dispatch(char *cmd)
 		if (*cmdtable[i].name && !strcmp(args[0], cmdtable[i].name)) {
 			KASSERT(cmdtable[i].func!=NULL);
 
-			gettime(&beforesecs, &beforensecs);
+			fast_gettime(&beforesecs, &beforensecs);
 
 			result = cmdtable[i].func(nargs, args);
 
-			gettime(&aftersecs, &afternsecs);
+			fast_gettime(&aftersecs, &afternsecs);
 			getinterval(beforesecs, beforensecs,
 				    aftersecs, afternsecs,
 				    &secs, &nsecs);
 
-			kprintf("Operation took %lu.%09lu seconds\n",
+			/*
+			 * fast_gettime is only good to about a tick,
+			 * so don't print nanoseconds; round to ms.
+			 */
+			nsecs = (nsecs + 500000) / 1000000;
+			if (nsecs >= 1000) {
+				nsecs -= 1000;
+				secs++;
+			}
+			kprintf("Operation took %lu.%03lu seconds\n",
 				(unsigned long) secs,
 				(unsigned long) nsecs);
 
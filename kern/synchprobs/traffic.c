@@ -407,9 +407,9 @@ vehicle_simulation(void * unusedpointer,
     /* this should block until it is OK for this vehicle to
        enter the intersection */
     /* we also measure the time spent blocked */
-    gettime(&before_sec,&before_nsec);
+    fast_gettime(&before_sec,&before_nsec);
     intersection_before_entry(v.origin, v.destination);
-    gettime(&after_sec,&after_nsec);
+    fast_gettime(&after_sec,&after_nsec);
 
     /* enter the intersection */
     /* note: we are setting a global pointer to point to a local
@@ -516,7 +516,7 @@ traffic_simulation(int nargs,
   initialize_state();
 
   /* get simulation start time */
-  gettime(&start_sec,&start_nsec);
+  fast_gettime(&start_sec,&start_nsec);
 
   for (i = 0; i < NumThreads; i++) {
     error = thread_fork("vehicle_simulation thread", NULL, vehicle_simulation, NULL, i);
@@ -531,7 +531,7 @@ traffic_simulation(int nargs,
   }
 
   /* get simulation end time */
-  gettime(&end_sec,&end_nsec);
+  fast_gettime(&end_sec,&end_nsec);
 
   /* clean up the simulation state */
   cleanup_state();
@@ -0,0 +1,162 @@
+/*
+ * Futex system calls: sleeping and waking on a word of user memory.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <wchan.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <syscall.h>
+
+/*
+ * A futex is identified by its address space and user address. Waiters
+ * sleep on one of FUTEX_BUCKETS wait channels, picked by hashing the
+ * two. Different futexes can share a bucket, so each waiter also puts
+ * a record on the bucket's list saying what it's waiting for; a wake
+ * marks the records that match and wakes the whole bucket, and anyone
+ * not marked goes back to sleep.
+ *
+ * The bucket lock is a sleep lock, because futex_wait has to read the
+ * user word (which may fault) while holding it. Holding it across the
+ * check and the sleep is what stops a wake from getting lost between
+ * them.
+ */
+#define FUTEX_BUCKETS 64
+
+struct futex_waiter {
+	struct addrspace *fw_as;
+	userptr_t fw_addr;
+	bool fw_woken;
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, userptr_t uaddr)
+{
+	unsigned hash;
+
+	hash = ((uintptr_t)as >> 4) ^ ((uintptr_t)uaddr >> 2);
+	return &futex_table[hash % FUTEX_BUCKETS];
+}
+
+/*
+ * futex_wait: if the int at UADDR is still VAL, sleep until a
+ * futex_wake on it. Returns EAGAIN if the value had already changed.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter w, **wp;
+	int cur, result;
+
+	if ((uintptr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	w.fw_as = curproc_getas();
+	w.fw_addr = uaddr;
+	w.fw_woken = false;
+	fb = futex_hash(w.fw_as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	/* go on the end of the list, so wakes are first come first served */
+	wp = &fb->fb_waiters;
+	while (*wp != NULL) {
+		wp = &(*wp)->fw_next;
+	}
+	w.fw_next = NULL;
+	*wp = &w;
+	while (!w.fw_woken) {
+		wchan_lock(fb->fb_wchan);
+		lock_release(fb->fb_lock);
+		wchan_sleep(fb->fb_wchan);
+		lock_acquire(fb->fb_lock);
+	}
+	/* the waker took us off the list */
+	lock_release(fb->fb_lock);
+
+	return 0;
+}
+
+/*
+ * futex_wake: wake up to NUM threads waiting on the int at UADDR.
+ * Returns how many were woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int num, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **wp, *w;
+	struct addrspace *as;
+	int woken;
+
+	if ((uintptr_t)uaddr % sizeof(int) != 0 || num < 0) {
+		return EINVAL;
+	}
+
+	as = curproc_getas();
+	fb = futex_hash(as, uaddr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	wp = &fb->fb_waiters;
+	while (*wp != NULL && woken < num) {
+		w = *wp;
+		if (w->fw_as == as && w->fw_addr == uaddr) {
+			*wp = w->fw_next;
+			w->fw_woken = true;
+			woken++;
+		}
+		else {
+			wp = &w->fw_next;
+		}
+	}
+	if (woken > 0) {
+		wchan_wakeall(fb->fb_wchan);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
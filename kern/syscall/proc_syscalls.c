@@ -11,6 +11,7 @@
 #include <copyinout.h>
 #include <mips/trapframe.h>
 #include <synch.h>
+#include <wchan.h>
 #include <kern/fcntl.h>
 #include <vfs.h>
 #include <limits.h>
@@ -22,33 +23,128 @@ int sys_fork(struct trapframe *tf, pid_t *retval) {
   }
 
   fork_proc->p_pid = curproc->pid;
+  /* the child stays in its parent's scheduling class */
+  if (curproc->p_share > 0) {
+    thread_setshare(fork_proc, curproc->p_share);
+  }
 
   as_copy(curproc_getas(), &(fork_proc->p_addrspace));
   if(fork_proc->p_addrspace == NULL) {
+    /* the child never ran; this just gives its PID back */
+    save_exit_code(fork_proc->pid, 0);
     proc_destroy(fork_proc);
     return ENOMEM;
   }
 
   struct trapframe *forked_tf = kmalloc(sizeof(struct trapframe));
   if(forked_tf == NULL) {
+    save_exit_code(fork_proc->pid, 0);
     proc_destroy(fork_proc);
     return ENOMEM;
   }
 
   memcpy(forked_tf, tf, sizeof(struct trapframe));
+  /*
+   * Once the child runs it might exit and be freed, so don't touch
+   * fork_proc after thread_fork succeeds; record the parent first and
+   * remember the PID.
+   */
+  pid_t child_pid = fork_proc->pid;
+  update_proc_parent_pid(child_pid, curproc->pid);
   int errno = thread_fork(curthread->t_name, fork_proc, (void *)enter_forked_process, forked_tf, 0);
   if (errno) {
+    update_proc_parent_pid(child_pid, -1);
+    save_exit_code(child_pid, 0);
     proc_destroy(fork_proc);
     kfree(forked_tf);
     forked_tf = NULL;
     return errno;
   }
-  update_proc_parent_pid(fork_proc->pid, curproc->pid);
-  *retval = fork_proc->pid;
+  *retval = child_pid;
 
   return 0;
 }
 
+/*
+ * vfork: like fork, except that the child borrows our address space
+ * instead of getting a copy of it, and we sleep until the child execs
+ * or exits and hands it back. So a child that is only going to exec
+ * something skips copying the whole address space.
+ *
+ * The child mustn't return from the function that called vfork, or
+ * do much of anything besides exec and _exit, since it's running on
+ * our stack.
+ */
+int sys_vfork(struct trapframe *tf, pid_t *retval) {
+  struct proc *fork_proc = proc_create_runprogram(curproc->p_name);
+  if(fork_proc == NULL) {
+    return ENPROC;
+  }
+
+  fork_proc->p_pid = curproc->pid;
+  if (curproc->p_share > 0) {
+    thread_setshare(fork_proc, curproc->p_share);
+  }
+
+  struct semaphore *done = sem_create("vfork", 0);
+  if(done == NULL) {
+    save_exit_code(fork_proc->pid, 0);
+    proc_destroy(fork_proc);
+    return ENOMEM;
+  }
+
+  struct trapframe *forked_tf = kmalloc(sizeof(struct trapframe));
+  if(forked_tf == NULL) {
+    sem_destroy(done);
+    save_exit_code(fork_proc->pid, 0);
+    proc_destroy(fork_proc);
+    return ENOMEM;
+  }
+
+  memcpy(forked_tf, tf, sizeof(struct trapframe));
+  fork_proc->p_addrspace = curproc_getas();
+  fork_proc->p_vfork_sem = done;
+  /* the child may be gone by the time we wake up */
+  pid_t child_pid = fork_proc->pid;
+  update_proc_parent_pid(child_pid, curproc->pid);
+  int errno = thread_fork(curthread->t_name, fork_proc, (void *)enter_forked_process, forked_tf, 0);
+  if (errno) {
+    fork_proc->p_addrspace = NULL;
+    fork_proc->p_vfork_sem = NULL;
+    sem_destroy(done);
+    update_proc_parent_pid(child_pid, -1);
+    save_exit_code(child_pid, 0);
+    proc_destroy(fork_proc);
+    kfree(forked_tf);
+    return errno;
+  }
+
+  /* wait for the child to finish with the address space */
+  P(done);
+  sem_destroy(done);
+  *retval = child_pid;
+
+  return 0;
+}
+
+/*
+ * Let go of the current process's address space, which is about to
+ * be replaced or thrown away. Normally that means destroying it, but
+ * a vforked child gives it back to its parent instead.
+ */
+static
+void
+release_addrspace(struct addrspace *as) {
+  struct semaphore *done = curproc->p_vfork_sem;
+
+  if (done == NULL) {
+    as_destroy(as);
+  } else {
+    curproc->p_vfork_sem = NULL;
+    V(done);
+  }
+}
+
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
@@ -73,7 +169,7 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
    as = curproc_setas(NULL);
-   as_destroy(as);
+   release_addrspace(as);
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -117,22 +213,46 @@ sys_waitpid(pid_t pid,
      Fix this!
   */
 
-     if (options != 0) {
+     if ((options & ~WNOHANG) != 0) {
       return(EINVAL);
     }
-    lock_acquire(all_procs_lock);
+    rwlock_acquire_read(all_procs_rwlock);
     struct proc_status* curr = get_proc_status(pid);
-    if(curr->p_pid != curproc->pid) {
-      return ECHILD;
-    } else if (curr == NULL) {
+    if (curr == NULL) {
+      rwlock_release_read(all_procs_rwlock);
       return ESRCH;
+    } else if(curr->p_pid != curproc->pid) {
+      rwlock_release_read(all_procs_rwlock);
+      return ECHILD;
     }
 
+    if (curr->status != 0 && (options & WNOHANG)) {
+      /* still running; say so without waiting */
+      rwlock_release_read(all_procs_rwlock);
+      *retval = 0;
+      return(0);
+    }
+
+    /*
+     * Our children wake us on our own record's waitchan when they
+     * exit. They need the lock for writing to do it, so they can't
+     * slip in between our check and our sleep.
+     */
+    struct proc_status *self = get_proc_status(curproc->pid);
     while(curr->status != 0) {
-      cv_wait(proc_cv, all_procs_lock);
+      wchan_lock(self->waitchan);
+      rwlock_release_read(all_procs_rwlock);
+      wchan_sleep(self->waitchan);
+      rwlock_acquire_read(all_procs_rwlock);
     }
+    rwlock_release_read(all_procs_rwlock);
+
+    /* only we can reap it, so it's still there */
+    rwlock_acquire_write(all_procs_rwlock);
     exitstatus = curr->exit_code;
-    lock_release(all_procs_lock);
+    /* reaped; the PID can be reused */
+    remove_proc_status(curr);
+    rwlock_release_write(all_procs_rwlock);
 
   /* for now, just pretend the exitstatus is 0 */
     
@@ -278,7 +398,7 @@ sys_waitpid(pid_t pid,
       }
     }
 
-    as_destroy(curr_addrspace);
+    release_addrspace(curr_addrspace);
 
   /* Warp to user mode. */
   enter_new_process(arg_count /*argc*/, (userptr_t) stackptr /*userspace addr of argv*/,
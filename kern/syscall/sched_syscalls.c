@@ -0,0 +1,79 @@
+/*
+ * Scheduling-related system calls.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <clock.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <thread.h>
+#include <current.h>
+#include <syscall.h>
+
+/*
+ * setshare: move the calling process into the proportional-share
+ * scheduling class with SHARE tickets, so it gets CPU time in
+ * proportion to SHARE relative to the other share-class processes on
+ * its cpu. A SHARE of 0 puts it back into ordinary timesharing.
+ */
+int
+sys_setshare(int share)
+{
+	if (share < 0 || share > SCHED_MAXSHARE) {
+		return EINVAL;
+	}
+
+	thread_setshare(curproc, share);
+	return 0;
+}
+
+/*
+ * setaffinity: restrict the calling thread to the cpus whose bits are
+ * set in MASK (bit 0 is cpu 0). Children forked afterwards inherit it.
+ * Other threads of the process, if it has any, are not affected; user
+ * processes only have the one thread.
+ */
+int
+sys_setaffinity(uint32_t mask)
+{
+	return thread_setaffinity(mask);
+}
+
+/*
+ * getrusage: report the calling process's CPU usage, summed over its
+ * threads. We don't tell user time from kernel time, so it all shows
+ * up as ru_utime; of the rest only the context switch counts are
+ * kept. There is no accounting for children, so RUSAGE_CHILDREN is
+ * refused.
+ */
+int
+sys_getrusage(int who, userptr_t user_usage)
+{
+	struct rusage ru;
+	struct thread *t;
+	unsigned i, ticks;
+
+	if (who != RUSAGE_SELF) {
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ticks = 0;
+	spinlock_acquire(&curproc->p_lock);
+	for (i=0; i<threadarray_num(&curproc->p_threads); i++) {
+		t = threadarray_get(&curproc->p_threads, i);
+		ticks += t->t_runticks;
+		ru.ru_nvcsw += t->t_nvcsw;
+		ru.ru_nivcsw += t->t_nivcsw;
+	}
+	spinlock_release(&curproc->p_lock);
+
+	ru.ru_utime.tv_sec = ticks / HZ;
+	ru.ru_utime.tv_usec = (ticks % HZ) * (1000000 / HZ);
+
+	return copyout(&ru, user_usage, sizeof(ru));
+}
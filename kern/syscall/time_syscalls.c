@@ -28,7 +28,11 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
 #include <clock.h>
+#include <thread.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +60,50 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Longest piece, in seconds, that sys_nanosleep hands to
+ * thread_sleep_ticks at once, to keep the tick count well clear of
+ * overflow.
+ */
+#define NANOSLEEP_MAXSECS  3600
+
+/*
+ * nanosleep: sleep for at least the requested time. The sleep is
+ * rounded up to whole hardclocks. As we have no signals the sleep is
+ * never interrupted, so if asked for it the remaining time is always
+ * zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	unsigned ticks;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	while (req.tv_sec > NANOSLEEP_MAXSECS) {
+		thread_sleep_ticks(NANOSLEEP_MAXSECS * HZ);
+		req.tv_sec -= NANOSLEEP_MAXSECS;
+	}
+	ticks = (unsigned)req.tv_sec * HZ + DIVROUNDUP(req.tv_nsec, 1000000000 / HZ);
+	thread_sleep_ticks(ticks);
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Timing for the benchmarks in the thread and synchronization tests.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <test.h>
+
+void
+bench_start(struct benchtime *bt)
+{
+	gettime(&bt->bt_secs, &bt->bt_nsecs);
+}
+
+void
+bench_stop(struct benchtime *bt)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	getinterval(bt->bt_secs, bt->bt_nsecs, secs, nsecs,
+		    &bt->bt_secs, &bt->bt_nsecs);
+}
+
+unsigned long
+bench_usecs(const struct benchtime *bt)
+{
+	return (unsigned long)bt->bt_secs * 1000000 + bt->bt_nsecs / 1000;
+}
+
+void
+bench_report(const struct benchtime *bt, unsigned count, const char *what)
+{
+	kprintf("%u %s in %lu.%09lu seconds (%lu us each)\n", count, what,
+		(unsigned long) bt->bt_secs, (unsigned long) bt->bt_nsecs,
+		bench_usecs(bt) / count);
+}
@@ -0,0 +1,157 @@
+/*
+ * Reader-writer lock test.
+ *
+ * A bunch of threads hammer on one rwlock, mostly reading. Writers
+ * check that nobody else is inside; readers check that no writer is
+ * and that the data doesn't change under them. The test is run once
+ * with reader preference and once with writer preference, and the
+ * time each run took is printed, so this doubles as a benchmark.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NRWTHREADS	16
+#define NRWLOOPS	2000
+#define WRITE_EVERY	16	/* one operation in this many is a write */
+
+static struct rwlock *testrw;
+static struct semaphore *rwdonesem;
+
+/* What's inside the lock right now; protected by inside_lock. */
+static struct spinlock inside_lock = SPINLOCK_INITIALIZER;
+static unsigned readers_inside;
+static unsigned writers_inside;
+
+/* The data; writers set both halves to the same value. */
+static volatile unsigned long rwval1;
+static volatile unsigned long rwval2;
+
+static volatile unsigned rwfailures;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: rwtest failure: %s\n", num, msg);
+	rwfailures++;
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	unsigned i, j;
+	unsigned long v;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (random() % WRITE_EVERY == 0) {
+			rwlock_acquire_write(testrw);
+			spinlock_acquire(&inside_lock);
+			if (readers_inside > 0 || writers_inside > 0) {
+				rwfail(num, "writer not alone");
+			}
+			writers_inside++;
+			spinlock_release(&inside_lock);
+
+			rwval1 = num;
+			for (j=0; j<100; j++) {
+				/* give someone a chance to notice */
+			}
+			rwval2 = num;
+
+			spinlock_acquire(&inside_lock);
+			writers_inside--;
+			spinlock_release(&inside_lock);
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			spinlock_acquire(&inside_lock);
+			if (writers_inside > 0) {
+				rwfail(num, "reader inside with a writer");
+			}
+			readers_inside++;
+			spinlock_release(&inside_lock);
+
+			v = rwval1;
+			for (j=0; j<100; j++) {
+				if (rwval1 != v || rwval2 != v) {
+					rwfail(num, "data changed under reader");
+					break;
+				}
+			}
+
+			spinlock_acquire(&inside_lock);
+			readers_inside--;
+			spinlock_release(&inside_lock);
+			rwlock_release_read(testrw);
+		}
+	}
+	V(rwdonesem);
+}
+
+static
+void
+rwtestrun(bool writerpref)
+{
+	struct benchtime bt;
+	int i, result;
+
+	testrw = rwlock_create("testrw", writerpref);
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwval1 = rwval2 = 0;
+
+	bench_start(&bt);
+	for (i=0; i<NRWTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWTHREADS; i++) {
+		P(rwdonesem);
+	}
+	bench_stop(&bt);
+
+	kprintf("%s preference: ", writerpref ? "writer" : "reader");
+	bench_report(&bt, NRWTHREADS * NRWLOOPS, "lock operations");
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	rwdonesem = sem_create("rwdonesem", 0);
+	if (rwdonesem == NULL) {
+		panic("rwtest: sem_create failed\n");
+	}
+	rwfailures = 0;
+
+	kprintf("Starting rwlock test...\n");
+	rwtestrun(false);
+	rwtestrun(true);
+	sem_destroy(rwdonesem);
+
+	if (rwfailures > 0) {
+		kprintf("rwlock test FAILED (%u failures)\n", rwfailures);
+	}
+	else {
+		kprintf("rwlock test done.\n");
+	}
+	return 0;
+}
@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -42,6 +43,9 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NBENCHTHREADS 8
+#define NBENCHLOOPS   200
+#define NBENCHWORK    200
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -127,13 +131,104 @@ semtestthread(void *junk, unsigned long num)
 #endif
 }
 
+/*
+ * Semaphore contention benchmark ("sy1 bench"): NBENCHTHREADS threads
+ * take turns through a semaphore used as a mutex, doing a little work
+ * while holding it. Run for an ordinary and a FIFO semaphore, and
+ * report the throughput and the 99th percentile and worst wait in P.
+ */
+static struct semaphore *benchsem;
+static struct semaphore *benchdone;
+static volatile unsigned long benchval;
+static uint32_t benchwaits[NBENCHTHREADS * NBENCHLOOPS];	/* usecs */
+
+static
+void
+sembenchthread(void *junk, unsigned long num)
+{
+	struct benchtime bt;
+	int i, j;
+
+	(void)junk;
+
+	for (i=0; i<NBENCHLOOPS; i++) {
+		bench_start(&bt);
+		P(benchsem);
+		bench_stop(&bt);
+		for (j=0; j<NBENCHWORK; j++) {
+			benchval++;
+		}
+		V(benchsem);
+
+		benchwaits[num*NBENCHLOOPS + i] = bench_usecs(&bt);
+	}
+	V(benchdone);
+}
+
+static
+void
+sembench(bool fifo)
+{
+	struct benchtime bt;
+	uint32_t w;
+	unsigned i, j, n;
+	int result;
+
+	benchsem = fifo ? sem_create_fifo("sembench", 1) :
+		sem_create("sembench", 1);
+	benchdone = sem_create("sembench-done", 0);
+	if (benchsem == NULL || benchdone == NULL) {
+		panic("sembench: sem_create failed\n");
+	}
+
+	bench_start(&bt);
+	for (i=0; i<NBENCHTHREADS; i++) {
+		result = thread_fork("sembench", NULL, sembenchthread,
+				     NULL, i);
+		if (result) {
+			panic("sembench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NBENCHTHREADS; i++) {
+		P(benchdone);
+	}
+	bench_stop(&bt);
+	sem_destroy(benchsem);
+	sem_destroy(benchdone);
+
+	/* Insertion sort, to find the percentile. */
+	n = NBENCHTHREADS * NBENCHLOOPS;
+	for (i=1; i<n; i++) {
+		w = benchwaits[i];
+		for (j=i; j>0 && benchwaits[j-1] > w; j--) {
+			benchwaits[j] = benchwaits[j-1];
+		}
+		benchwaits[j] = w;
+	}
+
+	kprintf("%s: ", fifo ? "fifo" : "plain");
+	bench_report(&bt, n, "P/V pairs");
+	kprintf("%s: wait p99 %u us, max %u us\n", fifo ? "fifo" : "plain",
+		benchwaits[n - n/100 - 1], benchwaits[n-1]);
+}
+
 int
 semtest(int nargs, char **args)
 {
 	int i, result;
 
-	(void)nargs;
-	(void)args;
+	if (nargs == 2 && !strcmp(args[1], "bench")) {
+		kprintf("Starting semaphore benchmark...\n");
+		sembench(false);
+		sembench(true);
+		kprintf("Semaphore benchmark done.\n");
+		return 0;
+	}
+	if (nargs > 1) {
+		kprintf("Usage: sy1 [bench]\n");
+		return EINVAL;
+	}
 
 	inititems();
 	kprintf("Starting semaphore test...\n");
@@ -31,12 +31,16 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <cpu.h>
 #include <thread.h>
+#include <current.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NROUNDTRIPS  1000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +148,138 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Fork/exit round-trip benchmark. Fork a thread that does nothing but
+ * exit, wait for it, and repeat; the time is dominated by creating and
+ * tearing down threads. An optional argument sets how many exited
+ * threads each cpu keeps for reuse (0 for none), so the cost with and
+ * without recycling can be compared.
+ *
+ * We pin ourselves (and so the children, which inherit the mask) to
+ * the cpu we're on. Then when P returns the child has not only posted
+ * the semaphore but exited and been cleaned up by the switch back to
+ * us, so each round trip includes putting the thread in the pool or
+ * freeing it.
+ */
+int
+threadtest4(int nargs, char **args)
+{
+	struct benchtime bt;
+	unsigned oldmax, poolmax;
+	int i, result;
+
+	if (nargs > 2) {
+		kprintf("Usage: tt4 [poolsize]\n");
+		return EINVAL;
+	}
+
+	init_sem();
+	kprintf("Starting thread test 4...\n");
+
+	poolmax = oldmax = thread_set_poolmax(0);
+	if (nargs == 2) {
+		poolmax = atoi(args[1]);
+	}
+	thread_set_poolmax(poolmax);
+	kprintf("Keeping up to %u exited threads per cpu\n", poolmax);
+
+	result = thread_setaffinity(1U << curcpu->c_number);
+	if (result) {
+		panic("threadtest4: thread_setaffinity failed: %s\n",
+		      strerror(result));
+	}
+
+	bench_start(&bt);
+	for (i=0; i<NROUNDTRIPS; i++) {
+		result = thread_fork("threadtest4", NULL, nullthread, NULL, 0);
+		if (result) {
+			panic("threadtest4: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		P(tsem);
+	}
+	bench_stop(&bt);
+
+	thread_setaffinity(0xffffffff);
+	thread_set_poolmax(oldmax);
+
+	bench_report(&bt, NROUNDTRIPS, "fork/exit round trips");
+	kprintf("Thread test 4 done.\n");
+
+	return 0;
+}
+
+static struct semaphore *pingsem, *pongsem;
+
+static
+void
+pongthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<(int)num; i++) {
+		P(pingsem);
+		V(pongsem);
+	}
+	V(tsem);
+}
+
+/*
+ * Semaphore ping-pong benchmark. This thread and a second one take
+ * turns through a pair of semaphores, so each round trip is two
+ * wakeups and two context switches; where the woken thread gets run
+ * matters a lot.
+ */
+int
+threadtest5(int nargs, char **args)
+{
+	struct benchtime bt;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	pingsem = sem_create("ping", 0);
+	pongsem = sem_create("pong", 0);
+	if (pingsem == NULL || pongsem == NULL) {
+		panic("threadtest5: sem_create failed\n");
+	}
+	kprintf("Starting thread test 5...\n");
+
+	result = thread_fork("threadtest5", NULL, pongthread, NULL,
+			     NROUNDTRIPS);
+	if (result) {
+		panic("threadtest5: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+
+	bench_start(&bt);
+	for (i=0; i<NROUNDTRIPS; i++) {
+		V(pingsem);
+		P(pongsem);
+	}
+	bench_stop(&bt);
+	P(tsem);
+
+	bench_report(&bt, NROUNDTRIPS, "semaphore round trips");
+
+	sem_destroy(pingsem);
+	sem_destroy(pongsem);
+	kprintf("Thread test 5 done.\n");
+
+	return 0;
+}
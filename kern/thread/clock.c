@@ -28,22 +28,24 @@
  */
 
 #include <types.h>
+#include <kern/time.h>
 #include <lib.h>
 #include <cpu.h>
-#include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <atomic.h>
+#include <vm.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Timed sleeps are handled by the per-cpu timer wheels in thread.c,
+ * which hardclock drives; see thread_sleep_ticks.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
- * skimp on that because we have a known-good hardware clock.
+ * skimp on that because we have a known-good hardware clock. We do
+ * keep a copy of it, good to a hardclock or so, for fast_gettime.
  */
 
 /*
@@ -54,9 +56,147 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * The time base for fast_gettime, which is also the time page shared
+ * read-only with user processes (see <kern/time.h>).
+ *
+ * This is a sequence lock. The writer makes tp_seq odd, updates the
+ * time, and makes it even again; readers take a copy and retry if the
+ * count was odd or changed meanwhile. So readers never block or
+ * write anything, and can't slow the writer down.
+ *
+ * It's kept without reading the clock device on every tick. One cpu,
+ * the timekeeper, advances it by 1/HZ on each of its hardclocks. A
+ * timekeeper about to go tickless idle gives the job up, and the next
+ * cpu to take a hardclock picks it up. Once a second timerclock sets
+ * it from the clock device again, which corrects any drift and ticks
+ * missed while nobody had the job; so does a cpu coming out of
+ * tickless idle, in case everyone was idle.
+ *
+ * timebase_busy keeps there from ever being two writers: a tick that
+ * finds an update already in progress is skipped. (That only happens
+ * when the update is from the clock device, which makes the tick
+ * moot.) Volatile keeps the compiler from reordering the accesses,
+ * and System/161 doesn't reorder memory operations, so no barriers
+ * are needed.
+ */
+#define TIMEKEEPER_NONE		(-1)
+#define NSECS_PER_TICK		(1000000000 / HZ)
+
+static struct timepage *timepage;
+static volatile int timebase_busy;
+static volatile int timekeeper = TIMEKEEPER_NONE;
+
+/*
+ * Set the time base to SECS/NSECS.
  */
-static struct wchan *lbolt;
+static
+void
+timebase_set(time_t secs, uint32_t nsecs)
+{
+	timepage->tp_seq++;
+	timepage->tp_sec = secs;
+	timepage->tp_nsec = nsecs;
+	timepage->tp_seq++;
+}
+
+void
+timebase_update(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (atomic_swap(&timebase_busy, 1) != 0) {
+		/* someone else is doing it */
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+	timebase_set(secs, nsecs);
+
+	timebase_busy = 0;
+}
+
+/*
+ * Advance the time base by one tick, if we're the timekeeper (or
+ * nobody is, in which case we are now). Called from hardclock.
+ */
+static
+void
+timebase_tick(void)
+{
+	int me = curcpu->c_number;
+	time_t secs;
+	uint32_t nsecs;
+
+	if (timekeeper != me &&
+	    atomic_cas(&timekeeper, TIMEKEEPER_NONE, me) != TIMEKEEPER_NONE) {
+		return;
+	}
+
+	if (atomic_swap(&timebase_busy, 1) != 0) {
+		return;
+	}
+
+	if (timepage->tp_seq == 0) {
+		/* never set; start from the clock device */
+		gettime(&secs, &nsecs);
+		timebase_set(secs, nsecs);
+		timebase_busy = 0;
+		return;
+	}
+
+	secs = timepage->tp_sec;
+	nsecs = timepage->tp_nsec + NSECS_PER_TICK;
+	if (nsecs >= 1000000000) {
+		nsecs -= 1000000000;
+		secs++;
+	}
+	timebase_set(secs, nsecs);
+
+	timebase_busy = 0;
+}
+
+void
+timebase_idle(void)
+{
+	if (timekeeper == (int)curcpu->c_number) {
+		timekeeper = TIMEKEEPER_NONE;
+	}
+}
+
+/*
+ * Read the time base, without locking. Returns false if it hasn't
+ * been set yet.
+ */
+bool
+timebase_get(time_t *secs, uint32_t *nsecs)
+{
+	unsigned seq;
+
+	if (timepage == NULL) {
+		/* too early in boot */
+		return false;
+	}
+
+	do {
+		seq = timepage->tp_seq;
+		*secs = timepage->tp_sec;
+		*nsecs = timepage->tp_nsec;
+	} while ((seq & 1) || seq != timepage->tp_seq);
+
+	return seq != 0;
+}
+
+/*
+ * Get the time to within a tick or so, without locking.
+ */
+void
+fast_gettime(time_t *secs, uint32_t *nsecs)
+{
+	if (!timebase_get(secs, nsecs)) {
+		gettime(secs, nsecs);
+	}
+}
 
 /*
  * Setup.
@@ -64,10 +204,22 @@ static struct wchan *lbolt;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	/* The timer wheels are set up by cpu_create. */
+
+	timepage = (struct timepage *)alloc_kpages(1);
+	if (timepage == NULL) {
+		panic("hardclock_bootstrap: Out of memory\n");
 	}
+	bzero(timepage, PAGE_SIZE);
+}
+
+/*
+ * Kernel address of the time page, for the VM system to map.
+ */
+vaddr_t
+clock_timepage(void)
+{
+	return (vaddr_t)timepage;
 }
 
 /*
@@ -77,8 +229,12 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	wchan_wakeall(lbolt);
+	/*
+	 * This used to wake everyone in clocksleep, once a second,
+	 * whether they were due or not. Nothing needs that now; it
+	 * just keeps fast_gettime honest.
+	 */
+	timebase_update();
 }
 
 /*
@@ -93,13 +249,17 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	timebase_tick();
+	thread_timer_tick();
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	if (thread_tick()) {
+		thread_yield();
+	}
 }
 
 /*
@@ -108,9 +268,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	while (num_secs > 0) {
-		wchan_lock(lbolt);
-		wchan_sleep(lbolt);
-		num_secs--;
+	if (num_secs > 0) {
+		thread_sleep_ticks(num_secs * HZ);
 	}
 }
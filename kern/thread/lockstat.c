@@ -0,0 +1,422 @@
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <clock.h>
+#include <mainbus.h>
+#include <lockstat.h>
+
+/*
+ * All the cpus, so lockstat_print can find their tables. Cpus are
+ * created one at a time during boot and never go away, so this needs
+ * no lock.
+ */
+#define LOCKSTAT_MAXCPUS 32
+static struct cpu *lockstat_cpus[LOCKSTAT_MAXCPUS];
+static unsigned lockstat_ncpus;
+
+/*
+ * Same-cpu waits or holds longer than this are taken to be the cycle
+ * counter stepping back (see mainbus_cycles), and are counted as zero.
+ */
+#define LOCKSTAT_BOGUS	0x80000000
+
+/* lss_cpu before there's a curcpu. */
+#define LOCKSTAT_NOCPU	((unsigned)-1)
+
+void
+lockstat_cpu_init(struct cpu *c)
+{
+	KASSERT(lockstat_ncpus < LOCKSTAT_MAXCPUS);
+	bzero(c->c_lockstat, sizeof(c->c_lockstat));
+	c->c_lockstat_dropped = 0;
+	lockstat_cpus[lockstat_ncpus++] = c;
+}
+
+void
+lockstat_start(struct lockstat_stamp *st)
+{
+	/* this must work before curcpu initialization */
+	if (!CURCPU_EXISTS()) {
+		st->lss_cycles = 0;
+		st->lss_cpu = LOCKSTAT_NOCPU;
+	}
+	else {
+		st->lss_cycles = mainbus_cycles();
+		st->lss_cpu = curcpu->c_number;
+	}
+	st->lss_havetime = timebase_get(&st->lss_secs, &st->lss_nsecs);
+}
+
+/*
+ * Work out the time since START as MS plus CYCLES. Call at splhigh.
+ *
+ * On the cpu START was taken on this is the cycle counter difference.
+ * If we've moved, the two cycle counts aren't comparable, so use the
+ * time base instead, which is coarser but the same on every cpu, and
+ * set *MOVED. If there's nothing to go on, the time is zero.
+ */
+static
+void
+lockstat_since(const struct lockstat_stamp *start,
+	       unsigned *ms, unsigned *cycles, bool *moved)
+{
+	unsigned per_ms = mainbus_cycles_per_ms();
+	time_t nowsecs, secs;
+	uint32_t nownsecs, nsecs;
+
+	*ms = 0;
+	*cycles = 0;
+	*moved = false;
+
+	if (start->lss_cpu == LOCKSTAT_NOCPU) {
+		/* started during boot, before there was a curcpu */
+		return;
+	}
+	if (start->lss_cpu == curcpu->c_number) {
+		*cycles = mainbus_cycles() - start->lss_cycles;
+		if (*cycles >= LOCKSTAT_BOGUS) {
+			*cycles = 0;
+		}
+		*ms = *cycles / per_ms;
+		*cycles %= per_ms;
+		return;
+	}
+
+	*moved = true;
+	if (!start->lss_havetime || !timebase_get(&nowsecs, &nownsecs)) {
+		return;
+	}
+	getinterval(start->lss_secs, start->lss_nsecs, nowsecs, nownsecs,
+		    &secs, &nsecs);
+	if (secs < 0) {
+		/* the time base was set back a little */
+		return;
+	}
+	*ms = secs * 1000 + nsecs / 1000000;
+	*cycles = (nsecs % 1000000) / 1000 * (per_ms / 1000);
+}
+
+/*
+ * Add ADDMS plus ADDCYCLES to the time MS/LEFTOVER.
+ */
+static
+void
+lockstat_addtime(unsigned *ms, unsigned *leftover,
+		 unsigned addms, unsigned addcycles)
+{
+	unsigned per_ms = mainbus_cycles_per_ms();
+
+	*ms += addms + addcycles / per_ms;
+	*leftover += addcycles % per_ms;
+	if (*leftover >= per_ms) {
+		*leftover -= per_ms;
+		(*ms)++;
+	}
+}
+
+/*
+ * True if entry LS is the one for LOCK/NAME. Names longer than the
+ * entry can hold only need to match as far as they were kept.
+ */
+static
+bool
+lockstat_match(struct lockstat *ls, const void *lock, const char *name)
+{
+	unsigned i;
+
+	if (name == NULL) {
+		return ls->ls_name[0] == 0 && ls->ls_addr == lock;
+	}
+	for (i=0; i<LOCKSTAT_NAMELEN - 1; i++) {
+		if (ls->ls_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+static
+bool
+lockstat_empty(struct lockstat *ls)
+{
+	return ls->ls_name[0] == 0 && ls->ls_addr == NULL;
+}
+
+/*
+ * Find (or make) the entry for LOCK/NAME in table TAB, which has
+ * NSLOTS slots. Open addressing with linear probing, hashing the name
+ * or, for spinlocks, the address. Returns NULL if the table is full.
+ */
+static
+struct lockstat *
+lockstat_lookup(struct lockstat *tab, unsigned nslots,
+		const void *lock, const char *name)
+{
+	unsigned hash, i, j, slot;
+
+	if (name == NULL) {
+		hash = (uintptr_t)lock >> 4;
+	}
+	else {
+		hash = 5381;
+		for (i=0; i<LOCKSTAT_NAMELEN - 1 && name[i] != 0; i++) {
+			hash = hash*33 + (unsigned char)name[i];
+		}
+	}
+
+	for (i=0; i<nslots; i++) {
+		slot = (hash + i) % nslots;
+		if (lockstat_empty(&tab[slot])) {
+			if (name == NULL) {
+				tab[slot].ls_addr = lock;
+			}
+			else {
+				for (j=0; j<LOCKSTAT_NAMELEN - 1 &&
+					    name[j] != 0; j++) {
+					tab[slot].ls_name[j] = name[j];
+				}
+			}
+			return &tab[slot];
+		}
+		if (lockstat_match(&tab[slot], lock, name)) {
+			return &tab[slot];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Get this cpu's entry for LOCK/NAME. Call at splhigh, so the thread
+ * can't be interrupted or moved to another cpu partway through.
+ */
+static
+struct lockstat *
+lockstat_get(const void *lock, const char *name)
+{
+	struct lockstat *ls;
+
+	if (name != NULL && name[0] == 0) {
+		/* can't key by an empty name */
+		name = NULL;
+	}
+	ls = lockstat_lookup(curcpu->c_lockstat, LOCKSTAT_SLOTS, lock, name);
+	if (ls == NULL) {
+		curcpu->c_lockstat_dropped++;
+	}
+	return ls;
+}
+
+void
+lockstat_acquired(const void *lock, const char *name, bool contended,
+		  const struct lockstat_stamp *start)
+{
+	struct lockstat *ls;
+	unsigned ms, cycles, per_ms;
+	uint32_t waited;
+	bool moved;
+	int s;
+
+	if (!CURCPU_EXISTS()) {
+		return;
+	}
+
+	s = splhigh();
+	ls = lockstat_get(lock, name);
+	if (ls != NULL) {
+		ls->ls_acquires++;
+		if (contended) {
+			ls->ls_contended++;
+			lockstat_since(start, &ms, &cycles, &moved);
+			lockstat_addtime(&ls->ls_waitms, &ls->ls_waitcycles,
+					 ms, cycles);
+			if (moved) {
+				ls->ls_xcpu++;
+			}
+
+			/* the max is kept in cycles, so cap it */
+			per_ms = mainbus_cycles_per_ms();
+			if (ms >= LOCKSTAT_BOGUS / per_ms) {
+				waited = LOCKSTAT_BOGUS;
+			}
+			else {
+				waited = ms * per_ms + cycles;
+			}
+			if (waited > ls->ls_waitmax) {
+				ls->ls_waitmax = waited;
+			}
+		}
+	}
+	splx(s);
+}
+
+void
+lockstat_released(const void *lock, const char *name,
+		  const struct lockstat_stamp *start)
+{
+	struct lockstat *ls;
+	unsigned ms, cycles;
+	bool moved;
+	int s;
+
+	if (!CURCPU_EXISTS()) {
+		return;
+	}
+
+	s = splhigh();
+	ls = lockstat_get(lock, name);
+	if (ls != NULL) {
+		lockstat_since(start, &ms, &cycles, &moved);
+		lockstat_addtime(&ls->ls_holdms, &ls->ls_holdcycles,
+				 ms, cycles);
+		if (moved) {
+			ls->ls_xcpu++;
+		}
+	}
+	splx(s);
+}
+
+/*
+ * Fold SRC into DEST.
+ */
+static
+void
+lockstat_merge(struct lockstat *dest, const struct lockstat *src)
+{
+	dest->ls_acquires += src->ls_acquires;
+	dest->ls_contended += src->ls_contended;
+	lockstat_addtime(&dest->ls_waitms, &dest->ls_waitcycles,
+			 src->ls_waitms, src->ls_waitcycles);
+	if (src->ls_waitmax > dest->ls_waitmax) {
+		dest->ls_waitmax = src->ls_waitmax;
+	}
+	lockstat_addtime(&dest->ls_holdms, &dest->ls_holdcycles,
+			 src->ls_holdms, src->ls_holdcycles);
+	dest->ls_xcpu += src->ls_xcpu;
+}
+
+/*
+ * Order by total wait, most first.
+ */
+static
+bool
+lockstat_worse(const struct lockstat *a, const struct lockstat *b)
+{
+	if (a->ls_waitms != b->ls_waitms) {
+		return a->ls_waitms > b->ls_waitms;
+	}
+	if (a->ls_waitcycles != b->ls_waitcycles) {
+		return a->ls_waitcycles > b->ls_waitcycles;
+	}
+	return a->ls_contended > b->ls_contended;
+}
+
+/*
+ * Print the NUM locks with the most total wait, over all cpus. The
+ * xcpu column counts the waits and holds that ended on a different
+ * cpu from the one they began on; those were timed with the time
+ * base, so are only good to a tick or so.
+ *
+ * The tables are read without stopping anyone from updating them, so
+ * numbers for busy locks may be a little inconsistent.
+ */
+void
+lockstat_print(unsigned num)
+{
+	struct lockstat *all, *ls, tmp;
+	unsigned nslots, nused, dropped;
+	unsigned i, j, per_us;
+
+	nslots = LOCKSTAT_SLOTS * lockstat_ncpus;
+	all = kmalloc(nslots * sizeof(*all));
+	if (all == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	bzero(all, nslots * sizeof(*all));
+
+	dropped = 0;
+	for (i=0; i<lockstat_ncpus; i++) {
+		for (j=0; j<LOCKSTAT_SLOTS; j++) {
+			ls = &lockstat_cpus[i]->c_lockstat[j];
+			if (lockstat_empty(ls)) {
+				continue;
+			}
+			/* copy first; the name might change under us */
+			tmp = *ls;
+			tmp.ls_name[LOCKSTAT_NAMELEN - 1] = 0;
+			ls = lockstat_lookup(all, nslots, tmp.ls_addr,
+					     tmp.ls_name[0] ? tmp.ls_name : NULL);
+			KASSERT(ls != NULL);
+			lockstat_merge(ls, &tmp);
+		}
+		dropped += lockstat_cpus[i]->c_lockstat_dropped;
+	}
+
+	/* Pack the used entries at the front, then selection sort. */
+	nused = 0;
+	for (i=0; i<nslots; i++) {
+		if (!lockstat_empty(&all[i])) {
+			all[nused++] = all[i];
+		}
+	}
+	if (num > nused) {
+		num = nused;
+	}
+	for (i=0; i<num; i++) {
+		for (j=i+1; j<nused; j++) {
+			if (lockstat_worse(&all[j], &all[i])) {
+				tmp = all[i];
+				all[i] = all[j];
+				all[j] = tmp;
+			}
+		}
+	}
+
+	per_us = mainbus_cycles_per_ms() / 1000;
+	kprintf("%-23s %9s %9s %9s %9s %9s %6s\n", "lock", "acquires",
+		"contended", "wait ms", "max us", "held ms", "xcpu");
+	for (i=0; i<num; i++) {
+		ls = &all[i];
+		if (ls->ls_name[0] != 0) {
+			kprintf("%-23s", ls->ls_name);
+		}
+		else {
+			kprintf("spinlock %-14p", ls->ls_addr);
+		}
+		kprintf(" %9u %9u %9u %9u %9u %6u\n", ls->ls_acquires,
+			ls->ls_contended, ls->ls_waitms,
+			ls->ls_waitmax / per_us, ls->ls_holdms, ls->ls_xcpu);
+	}
+	kprintf("%u locks, %u records dropped for lack of room\n",
+		nused, dropped);
+
+	kfree(all);
+}
+
+/*
+ * Zero all the tables. Like lockstat_print this doesn't stop other
+ * cpus, so a record or two made at the same moment may survive.
+ */
+void
+lockstat_clear(void)
+{
+	unsigned i;
+	int s;
+
+	for (i=0; i<lockstat_ncpus; i++) {
+		s = splhigh();
+		bzero(lockstat_cpus[i]->c_lockstat,
+		      sizeof(lockstat_cpus[i]->c_lockstat));
+		lockstat_cpus[i]->c_lockstat_dropped = 0;
+		splx(s);
+	}
+}
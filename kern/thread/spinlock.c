@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -48,8 +49,11 @@
 void
 spinlock_init(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
 	lk->lk_holder = NULL;
+	lk->lk_acquires = 0;
+	lk->lk_contended = 0;
 }
 
 /*
@@ -59,7 +63,8 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
 }
 
 /*
@@ -67,12 +72,15 @@ spinlock_cleanup(struct spinlock *lk)
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
  * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * atomic operation to take a ticket, and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	bool contended;
+	struct lockstat_stamp start;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,27 +95,32 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
+	/*
+	 * Taking a ticket is the only atomic operation; after that we
+	 * just read lk_serving until it's our turn. Only the holder
+	 * ever writes lk_serving, so waiting doesn't disturb anyone.
+	 */
+	ticket = spinlock_data_fetchinc(&lk->lk_next);
+	contended = false;
+	if (spinlock_data_get(&lk->lk_serving) != ticket) {
+		contended = true;
+		lockstat_start(&start);
+		while (spinlock_data_get(&lk->lk_serving) != ticket) {
+			/* spin */
 		}
-		break;
 	}
 
 	lk->lk_holder = mycpu;
+	lk->lk_acquires++;
+	if (contended) {
+		lk->lk_contended++;
+		/*
+		 * Only contended acquisitions go in the lockstat
+		 * tables; there are far too many spinlocks to keep a
+		 * record for each, and lk_acquires counts the rest.
+		 */
+		lockstat_acquired(lk, NULL, true, &start);
+	}
 }
 
 /*
@@ -122,7 +135,8 @@ spinlock_release(struct spinlock *lk)
 	}
 
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	/* Next, please. */
+	spinlock_data_set(&lk->lk_serving, lk->lk_serving + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -139,3 +153,36 @@ spinlock_do_i_hold(struct spinlock *lk)
 	/* Assume we can read lk_holder atomically enough for this to work */
 	return (lk->lk_holder == curcpu->c_self);
 }
+
+/*
+ * Check if anyone holds the lock: someone has taken a ticket that
+ * isn't done being served.
+ */
+bool
+spinlock_is_held(struct spinlock *lk)
+{
+	return lk->lk_next != lk->lk_serving;
+}
+
+/*
+ * Print the lock's contention counters, labeled NAME. They're read
+ * without locking, so may be a count or two out on a busy lock.
+ */
+void
+spinlock_printstats(const char *name, struct spinlock *lk)
+{
+	unsigned acquires, contended;
+
+	acquires = lk->lk_acquires;
+	contended = lk->lk_contended;
+	kprintf("%s: %u acquires, %u contended", name, acquires, contended);
+	/* Scale down so contended * 100 can't overflow. */
+	while (acquires > 0xffffffffU / 100) {
+		acquires >>= 1;
+		contended >>= 1;
+	}
+	if (acquires > 0) {
+		kprintf(" (%u%%)", contended * 100 / acquires);
+	}
+	kprintf("\n");
+}
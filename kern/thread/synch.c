@@ -37,8 +37,17 @@
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
+#include <atomic.h>
+#include <lockstat.h>
+
+/*
+ * How many times lock_acquire checks a held lock, while its holder is
+ * running elsewhere, before giving up and going to sleep.
+ */
+#define LOCK_SPIN_MAX	1000
 
 ////////////////////////////////////////////////////////////
 //
@@ -71,15 +80,31 @@
 
   spinlock_init(&sem->sem_lock);
   sem->sem_count = initial_count;
+  sem->sem_fifo = false;
+  sem->sem_waiters = 0;
 
   return sem;
 }
 
+struct semaphore *
+sem_create_fifo(const char *name, int initial_count)
+{
+    struct semaphore *sem;
+
+    sem = sem_create(name, initial_count);
+    if (sem != NULL) {
+        sem->sem_fifo = true;
+    }
+    return sem;
+}
+
 void
 sem_destroy(struct semaphore *sem)
 {
     KASSERT(sem != NULL);
 
+    KASSERT(sem->sem_waiters == 0);
+
 	/* wchan_cleanup will assert if anyone's waiting on it */
     spinlock_cleanup(&sem->sem_lock);
     wchan_destroy(sem->sem_wchan);
@@ -90,6 +115,9 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+    bool contended;
+    struct lockstat_stamp start;
+
     KASSERT(sem != NULL);
 
         /*
@@ -101,6 +129,32 @@ P(struct semaphore *sem)
          KASSERT(curthread->t_in_interrupt == false);
 
          spinlock_acquire(&sem->sem_lock);
+         contended = (sem->sem_count == 0);
+         lockstat_start(&start);
+
+         if (sem->sem_fifo && sem->sem_count == 0) {
+		/*
+		 * Join the queue. V will take us off it and hand us
+		 * the unit, so when we wake up it's ours and there's
+		 * nothing to check. (The count can only be nonzero
+		 * when nobody is queued, so newcomers can't jump the
+		 * queue either.)
+		 */
+		sem->sem_waiters++;
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+		wchan_sleep(sem->sem_wchan);
+		/*
+		 * V wakes us while still holding sem_lock. Wait for
+		 * it to let go, so it's done with the semaphore
+		 * before we return and maybe destroy it.
+		 */
+		spinlock_acquire(&sem->sem_lock);
+		spinlock_release(&sem->sem_lock);
+		lockstat_acquired(sem, sem->sem_name, contended, &start);
+		return;
+         }
+
          while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -111,12 +165,8 @@ P(struct semaphore *sem)
 		 * Note that we don't maintain strict FIFO ordering of
 		 * threads going through the semaphore; that is, we
 		 * might "get" it on the first try even if other
-		 * threads are waiting. Apparently according to some
-		 * textbooks semaphores must for some reason have
-		 * strict ordering. Too bad. :-)
-		 *
-		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * threads are waiting. Semaphores made with
+		 * sem_create_fifo do, above.
 		 */
       wchan_lock(sem->sem_wchan);
       spinlock_release(&sem->sem_lock);
@@ -127,6 +177,7 @@ P(struct semaphore *sem)
   KASSERT(sem->sem_count > 0);
   sem->sem_count--;
   spinlock_release(&sem->sem_lock);
+  lockstat_acquired(sem, sem->sem_name, contended, &start);
 }
 
 void
@@ -136,8 +187,16 @@ V(struct semaphore *sem)
 
     spinlock_acquire(&sem->sem_lock);
 
-    sem->sem_count++;
-    KASSERT(sem->sem_count > 0);
+    if (sem->sem_waiters > 0) {
+        /* FIFO: hand the unit to the longest waiter (wchans are FIFO). */
+        KASSERT(sem->sem_fifo);
+        KASSERT(sem->sem_count == 0);
+        sem->sem_waiters--;
+    }
+    else {
+        sem->sem_count++;
+        KASSERT(sem->sem_count > 0);
+    }
     wchan_wakeone(sem->sem_wchan);
 
     spinlock_release(&sem->sem_lock);
@@ -172,6 +231,8 @@ lock_create(const char *name)
     spinlock_init(&lock->lock_lock);
     lock->locked = false;
     lock->lock_holder = NULL;
+    lock->lock_holder_cpu = NULL;
+    bzero(&lock->lock_acqstamp, sizeof(lock->lock_acqstamp));
 
     return lock;
 }
@@ -188,14 +249,50 @@ lock_destroy(struct lock *lock)
     kfree(lock);
 }
 
+/*
+ * Check if LOCK's holder is running right now on another cpu, and so
+ * will likely release it soon. This is an unlocked peek. A cpu idling
+ * after its thread went to sleep still has that thread as c_curthread,
+ * hence the c_isidle check.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+    struct thread *holder = lock->lock_holder;
+    struct cpu *c = lock->lock_holder_cpu;
+
+    return holder != NULL && c != NULL && c != curcpu->c_self &&
+        c->c_curthread == holder && !c->c_isidle;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+    unsigned spins = 0;
+    bool contended;
+    struct lockstat_stamp start;
+
     KASSERT(NULL != lock);
     KASSERT(false == curthread->t_in_interrupt);
 
     spinlock_acquire(&lock->lock_lock);
+    contended = lock->locked;
+    lockstat_start(&start);
     while (lock->locked) {
+        if (spins < LOCK_SPIN_MAX && lock_holder_running(lock)) {
+            /*
+             * Spin (without the spinlock) rather than pay for
+             * two context switches.
+             */
+            spinlock_release(&lock->lock_lock);
+            while (lock->locked && spins < LOCK_SPIN_MAX &&
+                   lock_holder_running(lock)) {
+                spins++;
+            }
+            spinlock_acquire(&lock->lock_lock);
+            continue;
+        }
         wchan_lock(lock->lock_wchan);
         spinlock_release(&lock->lock_lock);
         wchan_sleep(lock->lock_wchan);
@@ -205,8 +302,12 @@ lock_acquire(struct lock *lock)
     KASSERT(NULL == lock->lock_holder);
     lock->locked = true;
     lock->lock_holder = curthread;
+    lock->lock_holder_cpu = curcpu->c_self;
 
     spinlock_release(&lock->lock_lock);
+
+    lockstat_start(&lock->lock_acqstamp);
+    lockstat_acquired(lock, lock->lk_name, contended, &start);
 }
 
 void
@@ -214,9 +315,11 @@ lock_release(struct lock *lock)
 {
     KASSERT(NULL != lock);
     KASSERT(true == lock_do_i_hold(lock));
+    lockstat_released(lock, lock->lk_name, &lock->lock_acqstamp);
     spinlock_acquire(&lock->lock_lock);
     lock->locked = false;
     lock->lock_holder = NULL;
+    lock->lock_holder_cpu = NULL;
     wchan_wakeone(lock->lock_wchan);
     spinlock_release(&lock->lock_lock);
 }
@@ -270,23 +373,238 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+    KASSERT(cv != NULL);
+    KASSERT(lock_do_i_hold(lock));
+
+    /*
+     * Lock the channel before releasing the lock, so a signaller
+     * (who must hold the lock) can't get in between and miss us.
+     */
+    wchan_lock(cv->cv_wchan);
     lock_release(lock);
-    wchan_wakeone(cv->cv_wchan);
+    wchan_sleep(cv->cv_wchan);
     lock_acquire(lock);
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-    lock_release(lock);
+    KASSERT(cv != NULL);
+    KASSERT(lock_do_i_hold(lock));
+
     wchan_wakeone(cv->cv_wchan);
-    lock_acquire(lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-    lock_release(lock);
-    wchan_wakeone(cv->cv_wchan);
-    lock_acquire(lock);
+    KASSERT(cv != NULL);
+    KASSERT(lock_do_i_hold(lock));
+
+    /*
+     * Everyone woken would go straight for the lock, which we hold,
+     * so put them to sleep on the lock instead. lock_release will
+     * wake them one by one, and each returns from wchan_sleep in
+     * cv_wait to find the lock (probably) free.
+     */
+    wchan_lock(cv->cv_wchan);
+    wchan_moveall(cv->cv_wchan, lock->lock_wchan);
+    wchan_unlock(cv->cv_wchan);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+/* rw_state: the reader count, and flags. */
+#define RW_READERS	0x0fffffff
+#define RW_WWAIT	0x20000000	/* writers waiting */
+#define RW_WRITER	0x40000000	/* a writer holds the lock */
+
+/*
+ * True if a reader seeing state STATE must wait.
+ */
+static
+bool
+rwlock_readers_blocked(struct rwlock *rw, int state)
+{
+	return (state & RW_WRITER) != 0 ||
+		(rw->rw_writerpref && (state & RW_WWAIT) != 0);
+}
+
+struct rwlock *
+rwlock_create(const char *name, bool writerpref)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_state = 0;
+	rw->rw_writerswaiting = 0;
+	rw->rw_writer = NULL;
+	rw->rw_writerpref = writerpref;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_state == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_writerswaiting == 0);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	int old;
+
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	/* Fast path: nothing in the way, so just count ourselves in. */
+	old = rw->rw_state;
+	while (!rwlock_readers_blocked(rw, old)) {
+		if (atomic_cas(&rw->rw_state, old, old + 1) == old) {
+			return;
+		}
+		old = rw->rw_state;
+	}
+
+	/*
+	 * Slow path. The flags only change with rw_lock held, so
+	 * once we have it only other readers can change rw_state
+	 * under us, and they only move the count.
+	 */
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	while (rwlock_readers_blocked(rw, rw->rw_state)) {
+		wchan_lock(rw->rw_readwchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_readwchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	atomic_fetchadd(&rw->rw_state, 1);
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	int old;
+
+	KASSERT(rw != NULL);
+
+	old = atomic_fetchadd(&rw->rw_state, -1);
+	KASSERT((old & RW_READERS) > 0);
+	if ((old & RW_READERS) == 1 && (old & RW_WWAIT) != 0) {
+		/*
+		 * Last reader out with a writer waiting. The writer
+		 * checks the count with rw_lock held and keeps it
+		 * until it's asleep, so it can't miss this.
+		 */
+		spinlock_acquire(&rw->rw_lock);
+		if (rw->rw_writerswaiting > 0) {
+			wchan_wakeone(rw->rw_writewchan);
+		}
+		spinlock_release(&rw->rw_lock);
+	}
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	int old;
+
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	if (rw->rw_writerswaiting++ == 0) {
+		atomic_fetchadd(&rw->rw_state, RW_WWAIT);
+	}
+	while (1) {
+		old = rw->rw_state;
+		if ((old & (RW_WRITER | RW_READERS)) == 0) {
+			/* a fast-path reader may beat us to it */
+			if (atomic_cas(&rw->rw_state, old,
+				       old | RW_WRITER) == old) {
+				break;
+			}
+			continue;
+		}
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	if (--rw->rw_writerswaiting == 0) {
+		atomic_fetchadd(&rw->rw_state, -RW_WWAIT);
+	}
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	atomic_fetchadd(&rw->rw_state, -RW_WRITER);
+	/*
+	 * With writer preference the next writer goes first, and the
+	 * readers wait until no writer is left. Otherwise let all the
+	 * readers in; a waiting writer is woken as well, and gets the
+	 * lock if it beats them to it.
+	 */
+	if (rw->rw_writerswaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	if (!rw->rw_writerpref || rw->rw_writerswaiting == 0) {
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rw_writer == curthread;
 }
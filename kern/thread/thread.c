@@ -40,6 +40,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <clock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -57,6 +58,51 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Rather than freeing exited threads and their stacks only to allocate
+ * new ones in thread_fork, each cpu keeps up to thread_pool_max of them
+ * around for reuse. The limit can be changed (see thread_set_poolmax)
+ * so the benchmarks can compare with recycling turned off.
+ */
+#define THREAD_POOL_MAX 8
+static unsigned thread_pool_max = THREAD_POOL_MAX;
+
+/*
+ * Scheduler tuning. Each level down the run queues (higher number,
+ * lower priority) gets twice the quantum of the level above it. A
+ * thread that has waited on a run queue for SCHED_STARVE_HARDCLOCKS
+ * is moved up a level by schedule() so CPU hogs can't be starved.
+ */
+#define SCHED_QUANTUM(level)	(1U << (level))
+#define SCHED_STARVE_HARDCLOCKS	(HZ / 2)
+
+/*
+ * Proportional-share (stride) scheduling. A process in the share
+ * class advances its pass by its stride, which is inversely
+ * proportional to its share, for every hardclock it runs. All the
+ * timesharing threads on a cpu compete together as a single client
+ * holding SCHED_TS_SHARE tickets. Whichever client has the lowest
+ * pass runs next. Pass values wrap around, so compare them only with
+ * PASS_BEFORE.
+ */
+#define SCHED_STRIDE1		(1U << 20)
+#define SCHED_TS_SHARE		100
+#define PASS_BEFORE(a, b)	((int)((a) - (b)) < 0)
+
+/*
+ * Work stealing. An idle cpu looks at no more than SCHED_STEAL_SCAN
+ * threads on its victim's run queue, and won't take a thread that
+ * was moved between cpus in the last SCHED_MOVE_HOLDOFF hardclocks.
+ */
+#define SCHED_STEAL_SCAN	8
+#define SCHED_MOVE_HOLDOFF	4
+
+/*
+ * A thread that last ran on a cpu less than SCHED_CACHE_HOT hardclocks
+ * ago is assumed to still have its working set in that cpu's cache.
+ */
+#define SCHED_CACHE_HOT		8
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -111,6 +157,48 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a new or recycled thread structure, other
+ * than the name and the stack, which the caller deals with.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+
+	/* Scheduler fields; new threads start out at top priority */
+	thread->t_priority = 0;
+	thread->t_quantum = SCHED_QUANTUM(0);
+	thread->t_readysince = 0;
+	thread->t_movedat = 0;
+	thread->t_lastcpu = NULL;
+	thread->t_lastrun = 0;
+	thread->t_affinity = 0xffffffff;
+	thread->t_wakeat = 0;
+
+	/* Accounting fields */
+	thread->t_runticks = 0;
+	thread->t_waitticks = 0;
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,23 +221,41 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
+	thread_init(thread);
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	return thread;
+}
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Take a thread from the current cpu's pool of recycled threads, if
+ * there is one. Its stack comes with it, guard band already in place.
+ */
+static
+struct thread *
+thread_recycle(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	DEBUGASSERT(name != NULL);
+
+	/* Keep the scheduler (and exorcise) off the pool while we look. */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_name = kstrdup(name);
+	if (thread->t_name == NULL) {
+		spl = splhigh();
+		threadlist_addhead(&curcpu->c_threadpool, thread);
+		splx(spl);
+		return NULL;
+	}
+	thread_init(thread);
 
 	return thread;
 }
@@ -167,6 +273,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i, j;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -180,11 +287,33 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_pushes = 0;
+	c->c_steals = 0;
+	c->c_busyticks = 0;
+	c->c_idleticks = 0;
+	c->c_switches = 0;
+	c->c_handoff = NULL;
+	threadlist_init(&c->c_threadpool);
+	lockstat_cpu_init(c);
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	threadlist_init(&c->c_sharequeue);
+	c->c_ts_pass = 0;
+	c->c_sched_vtime = 0;
 	spinlock_init(&c->c_runqueue_lock);
 
+	for (i=0; i<TIMER_LEVELS; i++) {
+		for (j=0; j<TIMER_SLOTS; j++) {
+			threadlist_init(&c->c_timers[i][j]);
+		}
+	}
+	c->c_timer_now = 0;
+	c->c_timer_count = 0;
+	spinlock_init(&c->c_timer_lock);
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -193,6 +322,8 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	/* Affinity masks have one bit per cpu. */
+	KASSERT(c->c_number < 32);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -262,9 +393,70 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Put a dead thread in the current cpu's pool for thread_fork to
+ * reuse, if there's room. Returns false if the caller should destroy
+ * it instead. Only threads with a stack of their own can be pooled.
+ */
+static
+bool
+thread_pool_put(struct thread *thread)
+{
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadpool.tl_count >= thread_pool_max) {
+		return false;
+	}
+
+	/* Check the old guard band, then lay down a fresh one. */
+	thread_checkstack(thread);
+	thread_checkstack_init(thread);
+
+	thread_machdep_cleanup(&thread->t_machdep);
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "POOLED";
+
+	threadlist_addtail(&curcpu->c_threadpool, thread);
+	return true;
+}
+
+/*
+ * Change the pool limit, and free whatever the current cpu's pool
+ * holds beyond it. Other cpus' pools shrink as they're used. The
+ * limit is read unlocked; a cpu that misses the change just pools or
+ * frees one thread too many.
+ */
+unsigned
+thread_set_poolmax(unsigned max)
+{
+	struct thread *thread;
+	unsigned old;
+	int spl;
+
+	old = thread_pool_max;
+	thread_pool_max = max;
+
+	while (1) {
+		spl = splhigh();
+		thread = NULL;
+		if (curcpu->c_threadpool.tl_count > max) {
+			thread = threadlist_remhead(&curcpu->c_threadpool);
+		}
+		splx(spl);
+		if (thread == NULL) {
+			break;
+		}
+		thread_destroy(thread);
+	}
+	return old;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them, or to be recycled.)
  *
  * The list of zombies is per-cpu.
  */
@@ -277,7 +469,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_pool_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -289,6 +483,8 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -303,9 +499,14 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = NULL;
-	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		curcpu->c_runqueue[i].tl_count = 0;
+		curcpu->c_runqueue[i].tl_head.tln_next = NULL;
+		curcpu->c_runqueue[i].tl_tail.tln_prev = NULL;
+	}
+	curcpu->c_sharequeue.tl_count = 0;
+	curcpu->c_sharequeue.tl_head.tln_next = NULL;
+	curcpu->c_sharequeue.tl_tail.tln_prev = NULL;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -426,10 +627,557 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue manipulation. Each cpu has one FIFO list per priority
+ * level for timesharing threads, plus a list of proportional-share
+ * threads kept sorted by pass. All of these require the cpu's run
+ * queue lock.
+ */
+
+/* Check if T belongs to the proportional-share class. */
+static
+bool
+thread_isshared(struct thread *t)
+{
+	return t->t_proc != NULL && t->t_proc->p_share > 0;
+}
+
+/* Count the timesharing threads waiting on C at priority LEVEL or better. */
+static
+unsigned
+runqueue_count_upto(struct cpu *c, unsigned level)
+{
+	unsigned i, total;
+
+	total = 0;
+	for (i=0; i<=level && i<SCHED_NLEVELS; i++) {
+		total += c->c_runqueue[i].tl_count;
+	}
+	return total;
+}
+
+/* Count all the threads waiting on C. */
+static
+unsigned
+runqueue_count(struct cpu *c)
+{
+	return runqueue_count_upto(c, SCHED_NLEVELS - 1) +
+		c->c_sharequeue.tl_count;
+}
+
+/*
+ * Return the first proportional-share thread on C if it is due to run
+ * ahead of the timesharing class, or NULL otherwise. TSRUNNING says a
+ * timesharing thread is running on C, in which case the class is in
+ * the running even if none of its threads are queued.
+ */
+static
+struct thread *
+runqueue_share_due(struct cpu *c, bool tsrunning)
+{
+	struct thread *t;
+
+	if (threadlist_isempty(&c->c_sharequeue)) {
+		return NULL;
+	}
+	t = c->c_sharequeue.tl_head.tln_next->tln_self;
+	if ((tsrunning || runqueue_count_upto(c, SCHED_NLEVELS - 1) > 0) &&
+	    PASS_BEFORE(c->c_ts_pass, t->t_proc->p_pass)) {
+		return NULL;
+	}
+	return t;
+}
+
+/* Queue T on C. */
+static
+void
+runqueue_add(struct cpu *c, struct thread *t)
+{
+	struct proc *proc;
+	struct thread *other;
+	struct threadlistnode *tln;
+
+	t->t_readysince = c->c_hardclocks;
+
+	if (thread_isshared(t)) {
+		proc = t->t_proc;
+
+		/* Don't let a process bank credit while it wasn't runnable. */
+		spinlock_acquire(&proc->p_lock);
+		if (PASS_BEFORE(proc->p_pass, c->c_sched_vtime)) {
+			proc->p_pass = c->c_sched_vtime;
+		}
+		spinlock_release(&proc->p_lock);
+
+		/*
+		 * Walk the nodes by hand; THREADLIST_FORALL can't cope
+		 * with an empty list.
+		 */
+		for (tln = c->c_sharequeue.tl_head.tln_next;
+		     tln->tln_next != NULL;
+		     tln = tln->tln_next) {
+			other = tln->tln_self;
+			if (PASS_BEFORE(proc->p_pass, other->t_proc->p_pass)) {
+				threadlist_insertbefore(&c->c_sharequeue,
+							t, other);
+				return;
+			}
+		}
+		threadlist_addtail(&c->c_sharequeue, t);
+		return;
+	}
+
+	/* Likewise for the timesharing class as a whole. */
+	if (runqueue_count_upto(c, SCHED_NLEVELS - 1) == 0 &&
+	    PASS_BEFORE(c->c_ts_pass, c->c_sched_vtime)) {
+		c->c_ts_pass = c->c_sched_vtime;
+	}
+
+	KASSERT(t->t_priority < SCHED_NLEVELS);
+	threadlist_addtail(&c->c_runqueue[t->t_priority], t);
+}
+
+/* Take the next thread to run, or NULL if there isn't one. */
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	struct thread *t;
+	unsigned i;
+
+	t = runqueue_share_due(c, false);
+	if (t != NULL) {
+		threadlist_remove(&c->c_sharequeue, t);
+		c->c_sched_vtime = t->t_proc->p_pass;
+		return t;
+	}
+
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		t = threadlist_remhead(&c->c_runqueue[i]);
+		if (t != NULL) {
+			c->c_sched_vtime = c->c_ts_pass;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Check if T was moved to another cpu too recently to be moved again.
+ */
+static
+bool
+thread_recently_moved(struct thread *t, unsigned now)
+{
+	return t->t_movedat != 0 && now - t->t_movedat < SCHED_MOVE_HOLDOFF;
+}
+
+/*
+ * Check if T's working set is presumably still in C's cache.
+ */
+static
+bool
+thread_cache_hot(struct thread *t, struct cpu *c, unsigned now)
+{
+	return t->t_lastcpu == c && now - t->t_lastrun < SCHED_CACHE_HOT;
+}
+
+/*
+ * Check if T's affinity mask lets it run on C.
+ */
+static
+bool
+thread_allowed(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & (1U << c->c_number)) != 0;
+}
+
+/*
+ * Assign T, which is on no run queue, to cpu C. Pass values only mean
+ * anything relative to their own cpu's virtual time, so a share-class
+ * thread that changes cpus keeps its lead on (or lag behind) the old
+ * cpu's virtual time rather than its raw pass. The old cpu's virtual
+ * time is read unlocked; being a little off is harmless.
+ */
+static
+void
+thread_set_cpu(struct thread *t, struct cpu *c)
+{
+	struct cpu *old = t->t_cpu;
+	struct proc *proc;
+
+	if (old != NULL && old != c && thread_isshared(t)) {
+		proc = t->t_proc;
+		spinlock_acquire(&proc->p_lock);
+		proc->p_pass = proc->p_pass - old->c_sched_vtime +
+			c->c_sched_vtime;
+		spinlock_release(&proc->p_lock);
+	}
+	t->t_cpu = c;
+}
+
+/*
+ * Move up to MAX threads that may be migrated from C's run queues onto
+ * VICTIMS. We look from the back of the lowest-priority queue forward,
+ * so the threads that would wait longest go first. If COLDONLY is set,
+ * threads that are still cache-hot on C are left where they are.
+ * C's run queue lock must be held.
+ */
+static
+void
+runqueue_pick_victims(struct cpu *c, struct threadlist *victims,
+		      unsigned max, bool coldonly, unsigned now)
+{
+	struct threadlist *tl;
+	struct threadlistnode *tln;
+	struct thread *t;
+	unsigned i;
+
+	for (i=0; i<=SCHED_NLEVELS && victims->tl_count < max; i++) {
+		tl = (i == SCHED_NLEVELS) ?
+			&c->c_sharequeue : &c->c_runqueue[SCHED_NLEVELS - 1 - i];
+		tln = tl->tl_tail.tln_prev;
+		while (tln->tln_prev != NULL && victims->tl_count < max) {
+			t = tln->tln_self;
+			tln = tln->tln_prev;
+			/* Still on its own stack; see runqueue_steal. */
+			if (t == c->c_curthread) {
+				continue;
+			}
+			/* Pinned to C. */
+			if ((t->t_affinity & ~(1U << c->c_number)) == 0) {
+				continue;
+			}
+			if (thread_recently_moved(t, now)) {
+				continue;
+			}
+			if (coldonly && thread_cache_hot(t, c, now)) {
+				continue;
+			}
+			threadlist_remove(tl, t);
+			threadlist_addhead(victims, t);
+		}
+	}
+}
+
+/*
+ * Find a thread on victim cpu C that cpu THIEF may take, and remove it
+ * from C's run queues. We look from the back, at the threads that
+ * would otherwise wait longest. C's run queue lock must be held.
+ */
+static
+struct thread *
+runqueue_steal(struct cpu *c, struct cpu *thief, unsigned now)
+{
+	struct threadlist *tl;
+	struct threadlistnode *tln;
+	struct thread *t;
+	unsigned i, scanned;
+
+	scanned = 0;
+	for (i=SCHED_NLEVELS+1; i-- > 0; ) {
+		tl = (i == SCHED_NLEVELS) ? &c->c_sharequeue : &c->c_runqueue[i];
+		for (tln = tl->tl_tail.tln_prev;
+		     tln->tln_prev != NULL;
+		     tln = tln->tln_prev) {
+			t = tln->tln_self;
+			if (scanned++ >= SCHED_STEAL_SCAN) {
+				return NULL;
+			}
+			/*
+			 * C's current thread can be on its run queue
+			 * if C went idle after it slept and it was
+			 * woken again; it's still on its own stack, so
+			 * it must not be run anywhere else.
+			 */
+			if (t == c->c_curthread) {
+				continue;
+			}
+			if (!thread_allowed(t, thief)) {
+				continue;
+			}
+			if (thread_recently_moved(t, now)) {
+				continue;
+			}
+			threadlist_remove(tl, t);
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Work stealing: called by a cpu that has nothing to run, before it
+ * idles. Pull one thread over from the peer with the longest run
+ * queue. Only one attempt is made per trip around the idle loop; if
+ * we lose a race we just idle until the next interrupt and try again.
+ * (thread_idle keeps the clock ticking while that's the case.)
+ *
+ * Our own run queue lock must *not* be held, since holding two run
+ * queue locks at once could deadlock against another cpu doing the
+ * same thing. The stolen thread is on no list in between, and as it's
+ * S_READY nobody else can touch it.
+ *
+ * Returns true if a thread was put on our run queue.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, count, best, now;
+
+	KASSERT(!spinlock_do_i_hold(&curcpu->c_runqueue_lock));
+
+	/* Unlocked peek at the queue lengths; good enough for a guess. */
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = runqueue_count(c);
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	now = curcpu->c_hardclocks;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = runqueue_steal(victim, curcpu->c_self, now);
+	spinlock_release(&victim->c_runqueue_lock);
+	if (t == NULL) {
+		return false;
+	}
+
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u\n",
+	      t->t_name, victim->c_number, curcpu->c_number);
+
+	thread_set_cpu(t, curcpu->c_self);
+	t->t_movedat = now;
+	curcpu->c_steals++;
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	runqueue_add(curcpu, t);
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return true;
+}
+
+/*
+ * Idle until the next interrupt. If no other cpu has threads waiting
+ * there is nothing for the timer to wake us up for, so switch it off
+ * rather than take HZ useless interrupts a second; new work comes
+ * with an IPI_UNIDLE (see thread_make_runnable). The ticks we sleep
+ * through are credited to c_hardclocks afterwards so that anything
+ * measured in hardclocks stays roughly right.
+ *
+ * If a peer does have waiting threads that thread_steal wouldn't
+ * take yet, or someone on our timer wheel needs waking, keep ticking.
+ */
+static
+void
+thread_idle(void)
+{
+	struct cpu *c;
+	unsigned i, numcpus, missed;
+
+	if (curcpu->c_timer_count > 0) {
+		cpu_idle();
+		return;
+	}
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self && runqueue_count(c) > 0) {
+			cpu_idle();
+			return;
+		}
+	}
+
+	timebase_idle();
+	mainbus_hardclock_stop();
+	cpu_idle();
+	missed = mainbus_hardclock_start();
+	curcpu->c_hardclocks += missed;
+	curcpu->c_idleticks += missed;
+	/* the time of day may be stale if everyone was idle */
+	timebase_update();
+}
+
+/*
+ * T has just been queued on BUSY, which is running something else.
+ * If it's behind other queued work there, wake up one idle cpu that
+ * T is allowed on, if there is one, so it can come and steal some.
+ * Idle cpus don't take clock interrupts, so otherwise nobody would
+ * notice. If T is alone in the queue it'll get BUSY soon enough, and
+ * an idle cpu woken for it would most likely find nothing to take.
+ *
+ * BUSY's run queue lock must be held.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy, struct thread *t)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	KASSERT(spinlock_do_i_hold(&busy->c_runqueue_lock));
+
+	if (runqueue_count(busy) < 2) {
+		return;
+	}
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != busy && c->c_isidle && thread_allowed(t, c)) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
+/*
+ * Put T on C's timer wheel according to its t_wakeat, which must not
+ * be in the past. The slot is picked by how far away the deadline
+ * is: each level is TIMER_SLOTS times coarser than the one below.
+ * Deadlines beyond the top level are parked in its furthest slot and
+ * simply placed again when that slot comes round.
+ *
+ * C's timer lock must be held.
+ */
+static
+void
+timer_insert(struct cpu *c, struct thread *t)
+{
+	unsigned delta, expires, level;
+
+	KASSERT(spinlock_do_i_hold(&c->c_timer_lock));
+
+	delta = t->t_wakeat - c->c_timer_now;
+	expires = t->t_wakeat;
+	if (delta >= 1U << (TIMER_LEVELS * TIMER_SLOTBITS)) {
+		delta = (1U << (TIMER_LEVELS * TIMER_SLOTBITS)) - 1;
+		expires = c->c_timer_now + delta;
+	}
+	for (level = 0; level < TIMER_LEVELS - 1; level++) {
+		if (delta < 1U << ((level + 1) * TIMER_SLOTBITS)) {
+			break;
+		}
+	}
+	expires = (expires >> (level * TIMER_SLOTBITS)) & (TIMER_SLOTS - 1);
+	threadlist_addtail(&c->c_timers[level][expires], t);
+}
+
+/*
+ * Pick a cpu for thread T, which is being woken up (or has just been
+ * created) by the current thread. Going back to the cpu it last ran
+ * on keeps its cache, but if that cpu is busy T may wait a long time.
+ * In order of preference:
+ *    - its old cpu, if that is idle;
+ *    - any idle cpu, checking ours first (an interrupt handler may
+ *      be doing the waking from the idle loop);
+ *    - our cpu, if it has less queued than the old one. Typically
+ *      the waker is about to block waiting for T's answer, and then
+ *      T gets the cpu, warm with whatever it was just handed;
+ *    - its old cpu.
+ * Only cpus in T's affinity mask count, and if neither ours nor its
+ * old one is among them, the least loaded one that is gets it.
+ * All of this is decided from unlocked peeks; a stale answer just
+ * costs a little time.
+ */
+static
+struct cpu *
+thread_wake_target(struct thread *t)
+{
+	struct cpu *prev, *here, *c, *best;
+	unsigned i, numcpus;
+
+	prev = t->t_cpu;
+	here = curcpu->c_self;
+
+	if (prev->c_isidle && thread_allowed(t, prev)) {
+		return prev;
+	}
+
+	numcpus = cpuarray_num(&allcpus);
+	if (here->c_isidle && thread_allowed(t, here)) {
+		c = here;
+	}
+	else {
+		best = NULL;
+		for (i=0; i<numcpus; i++) {
+			c = cpuarray_get(&allcpus, i);
+			if (!thread_allowed(t, c)) {
+				continue;
+			}
+			if (c->c_isidle) {
+				break;
+			}
+			if (best == NULL ||
+			    runqueue_count(c) < runqueue_count(best)) {
+				best = c;
+			}
+		}
+		if (i == numcpus) {
+			if (!thread_allowed(t, here)) {
+				c = thread_allowed(t, prev) ? prev : best;
+			}
+			else if (!thread_allowed(t, prev)) {
+				c = here;
+			}
+			else {
+				c = (runqueue_count(here) <
+				     runqueue_count(prev)) ? here : prev;
+			}
+		}
+	}
+	KASSERT(c != NULL);
+
+	if (c != prev) {
+		/*
+		 * T may not have finished switching out on PREV yet,
+		 * and then it has to stay there; see runqueue_steal.
+		 * Once PREV's run queue lock is free and T isn't its
+		 * current thread, T is off its stack.
+		 *
+		 * PREV holds its run queue lock without a break from
+		 * before T could be seen to wake until T's switch is
+		 * done, except while idling with T still current. So
+		 * if T isn't current and after that the lock is seen
+		 * free, T is off its stack and we needn't lock to know
+		 * it. Only if the lock looks busy do we take it to
+		 * make sure. (Read c_curthread first, and for real.)
+		 */
+		if (*(struct thread * volatile *)&prev->c_curthread == t) {
+			c = prev;
+		}
+		else if (spinlock_is_held(&prev->c_runqueue_lock)) {
+			spinlock_acquire(&prev->c_runqueue_lock);
+			if (prev->c_curthread == t) {
+				c = prev;
+			}
+			spinlock_release(&prev->c_runqueue_lock);
+		}
+	}
+	return c;
+}
+
 /*
  * Make a thread runnable.
  *
  * targetcpu might be curcpu; it might not be, too. 
+ *
+ * Unless the caller already holds the run queue lock (in which case
+ * it's thread_switch requeueing the current thread), this is a wakeup
+ * or a new thread and thread_wake_target may send it elsewhere.
  */
 static
 void
@@ -438,6 +1186,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	struct cpu *targetcpu;
 	bool isidle;
 
+	if (!already_have_lock) {
+		thread_set_cpu(target, thread_wake_target(target));
+	}
+
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
@@ -450,7 +1202,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_add(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -458,12 +1210,94 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (!already_have_lock) {
+		/*
+		 * New work for a busy cpu (as opposed to a thread
+		 * being requeued by thread_switch): let an idle cpu
+		 * know it might be able to take some.
+		 */
+		thread_kick_idle(targetcpu, target);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
 	}
 }
 
+/*
+ * Make every thread on LIST runnable, emptying it. The threads are
+ * handled a cpu at a time: each cpu's share goes onto its run queue
+ * under one acquisition of the run queue lock and gets at most one
+ * IPI, instead of one of each per thread.
+ *
+ * Unlike thread_make_runnable this doesn't use thread_wake_target:
+ * it would send the whole crowd to the first idle cpu it found.
+ * The threads go back where they came from and thread_steal sorts
+ * out any imbalance.
+ */
+static
+void
+thread_make_runnable_list(struct threadlist *list)
+{
+	struct threadlistnode *tln, *next;
+	struct thread *t, *last;
+	struct cpu *targetcpu;
+
+	/* Anyone whose affinity changed since they last ran must move. */
+	for (tln = list->tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		t = tln->tln_self;
+		if (!thread_allowed(t, t->t_cpu)) {
+			thread_set_cpu(t, thread_wake_target(t));
+		}
+	}
+
+	while (!threadlist_isempty(list)) {
+		targetcpu = list->tl_head.tln_next->tln_self->t_cpu;
+
+		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		last = NULL;
+		for (tln = list->tl_head.tln_next; tln->tln_next != NULL;
+		     tln = next) {
+			next = tln->tln_next;
+			t = tln->tln_self;
+			if (t->t_cpu == targetcpu) {
+				threadlist_remove(list, t);
+				runqueue_add(targetcpu, t);
+				last = t;
+			}
+		}
+		/* Same as thread_make_runnable. */
+		if (targetcpu->c_isidle) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+		}
+		else {
+			/* the last one queued is the one waiting longest */
+			thread_kick_idle(targetcpu, last);
+		}
+		spinlock_release(&targetcpu->c_runqueue_lock);
+	}
+}
+
+/*
+ * Called by each thread coming off thread_switch (or starting up in
+ * thread_startup) on this cpu: if the thread that just switched out
+ * was ready to run but isn't allowed on this cpu any more, it's now
+ * safely off its stack, so queue it somewhere it is allowed.
+ */
+static
+void
+thread_handoff(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_handoff;
+	if (t != NULL) {
+		curcpu->c_handoff = NULL;
+		thread_make_runnable(t, false);
+	}
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -487,18 +1321,21 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	newthread = thread_recycle(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -506,6 +1343,7 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = curthread->t_affinity;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -570,24 +1408,62 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
+	/* Remember where and when we last ran, for cache affinity. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastrun = curcpu->c_hardclocks;
+
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. (Even if
+	 * we're not supposed to be on this cpu, as we can only leave
+	 * it by switching to something else; thread_setaffinity makes
+	 * sure there is something.)
+	 */
+	if (newstate == S_READY && runqueue_count(curcpu) == 0) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/* A yield from the timer interrupt is a preemption. */
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_nvcsw++;
+	}
+	curcpu->c_switches++;
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		if (!thread_allowed(cur, curcpu->c_self)) {
+			/*
+			 * We can't be queued elsewhere while we're
+			 * still on our stack; the next thread to run
+			 * here does it for us. See thread_handoff.
+			 */
+			KASSERT(curcpu->c_handoff == NULL);
+			curcpu->c_handoff = cur;
+			break;
+		}
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
+		if (wc == NULL) {
+			/*
+			 * Timed sleep: same as below, but the "channel"
+			 * is this cpu's timer wheel. See timer_insert.
+			 */
+			cur->t_wchan_name = "timer";
+			timer_insert(curcpu->c_self, cur);
+			spinlock_release(&curcpu->c_timer_lock);
+			break;
+		}
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -613,7 +1489,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call md_idle().
+	 * Get the next thread. While there isn't one, try to steal one
+	 * from another cpu, and failing that call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
@@ -632,15 +1509,26 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runqueue_remhead(curcpu);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!thread_steal()) {
+				thread_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/*
+	 * Charge the time it spent queued. t_readysince may come from
+	 * another cpu's clock if it was stolen, so don't trust it to
+	 * be in the past.
+	 */
+	if ((int)(curcpu->c_hardclocks - next->t_readysince) > 0) {
+		next->t_waitticks += curcpu->c_hardclocks - next->t_readysince;
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -708,6 +1596,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the previous thread, if it doesn't belong here. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -741,6 +1632,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the previous thread, if it doesn't belong here. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -820,19 +1714,193 @@ thread_yield(void)
 ////////////////////////////////////////////////////////////
 
 /*
- * Scheduler.
+ * Timeslicing.
+ *
+ * This is called from hardclock() on every tick. A thread that burns
+ * through its whole quantum is assumed to be CPU-bound and drops a
+ * priority level, which doubles its next quantum. A thread is also
+ * preempted early if something more urgent is waiting on this cpu;
+ * in that case it keeps what is left of its quantum.
+ *
+ * Proportional-share threads are instead charged their process's
+ * stride, and timesharing threads charge the class's stride. The tick
+ * is also counted towards the thread's and the cpu's run time.
+ *
+ * Returns true if hardclock should yield. With nothing else on the
+ * run queue it never should: thread_switch would only pick us again.
+ * (The queue lengths are peeked at unlocked; a wrong guess costs at
+ * most one tick.)
+ */
+bool
+thread_tick(void)
+{
+	struct thread *cur;
+	struct proc *proc;
+	bool preempt;
+
+	/* Nothing to charge if the idle loop was interrupted. */
+	if (curcpu->c_isidle) {
+		curcpu->c_idleticks++;
+		return false;
+	}
+
+	cur = curthread;
+	cur->t_runticks++;
+	curcpu->c_busyticks++;
+	proc = cur->t_proc;
+
+	if (proc != NULL && proc->p_share > 0) {
+		/*
+		 * Proportional-share threads are charged their stride
+		 * and reconsidered on every tick.
+		 */
+		spinlock_acquire(&proc->p_lock);
+		proc->p_pass += proc->p_stride;
+		spinlock_release(&proc->p_lock);
+		return runqueue_count(curcpu) > 0;
+	}
+
+	curcpu->c_ts_pass += SCHED_STRIDE1 / SCHED_TS_SHARE;
+
+	KASSERT(cur->t_quantum > 0);
+	cur->t_quantum--;
+	if (cur->t_quantum == 0) {
+		if (cur->t_priority < SCHED_NLEVELS - 1) {
+			cur->t_priority++;
+		}
+		cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+		/* Don't bother switching if there's nobody to switch to. */
+		return runqueue_count(curcpu) > 0;
+	}
+
+	if (runqueue_count(curcpu) == 0) {
+		return false;
+	}
+
+	/*
+	 * We're the timesharing class's runner, so a share-class
+	 * thread is only due if its pass is behind the class's, even
+	 * when no other timesharing thread is queued.
+	 */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	preempt = runqueue_share_due(curcpu, true) != NULL ||
+		(cur->t_priority > 0 &&
+		 runqueue_count_upto(curcpu, cur->t_priority - 1) > 0);
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return preempt;
+}
+
+/*
+ * Move a process between scheduling classes. Its pass starts at this
+ * cpu's current virtual time so it neither owes nor is owed anything.
+ */
+void
+thread_setshare(struct proc *proc, unsigned share)
+{
+	KASSERT(share <= SCHED_MAXSHARE);
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_share = share;
+	proc->p_stride = (share > 0) ? SCHED_STRIDE1 / share : 0;
+	proc->p_pass = curcpu->c_sched_vtime;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Entry point for the thread thread_setaffinity leaves behind.
+ */
+static
+void
+thread_standin(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+}
+
+/*
+ * Set the current thread's affinity mask. Nobody else changes it, and
+ * while we're running we're on no run queue, so no locking is needed.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * If we're now on the wrong cpu we have to leave it, but we can only
+ * be queued elsewhere once we're off our stack, which takes something
+ * else to switch to here (see thread_handoff). If this cpu has nothing
+ * else to run, fork a stand-in, pinned here, that exits at once. We
+ * pin ourselves while forking it so it inherits that mask; if we're
+ * preempted before the yield and the stand-in runs first, go round
+ * again.
  */
+int
+thread_setaffinity(uint32_t mask)
+{
+	unsigned numcpus;
+	uint32_t oldmask;
+	int result;
 
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 32) {
+		mask &= (1U << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	oldmask = curthread->t_affinity;
+	while ((mask & (1U << curcpu->c_number)) == 0) {
+		if (runqueue_count(curcpu) == 0) {
+			curthread->t_affinity = 1U << curcpu->c_number;
+			result = thread_fork("affinity", kproc,
+					     thread_standin, NULL, 0);
+			if (result) {
+				curthread->t_affinity = oldmask;
+				return result;
+			}
+		}
+		curthread->t_affinity = mask;
+		thread_yield();
+	}
+	curthread->t_affinity = mask;
+	return 0;
+}
+
+/*
+ * Scheduler.
+ *
+ * This is called periodically from hardclock(). It ages the current
+ * CPU's run queues: any thread that has been waiting at a lower
+ * priority level for SCHED_STARVE_HARDCLOCKS is moved up one level.
+ * Each level is a FIFO in order of arrival, so we can stop looking at
+ * a level as soon as we find a thread that isn't starving yet.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlist *tl;
+	struct thread *t;
+	unsigned level, now;
+
+	/* Nothing waiting, nothing to age; skip the lock. */
+	if (runqueue_count(curcpu) == 0) {
+		return;
+	}
+
+	now = curcpu->c_hardclocks;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (level = 1; level < SCHED_NLEVELS; level++) {
+		tl = &curcpu->c_runqueue[level];
+		while (!threadlist_isempty(tl)) {
+			t = tl->tl_head.tln_next->tln_self;
+			if (now - t->t_readysince < SCHED_STARVE_HARDCLOCKS) {
+				break;
+			}
+			threadlist_remove(tl, t);
+			t->t_priority = level - 1;
+			t->t_quantum = SCHED_QUANTUM(t->t_priority);
+			t->t_readysince = now;
+			threadlist_addtail(&curcpu->c_runqueue[level - 1], t);
+		}
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
@@ -848,43 +1916,51 @@ schedule(void)
  * and the performance loss due to underutilization of some CPUs is
  * something that needs to be tuned and probably is workload-specific.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * System/161 does not (yet) model such cache effects, but real
+ * hardware does, so we prefer to send threads that haven't run here
+ * recently and whose cache footprint is presumably gone. Threads that
+ * are still hot only go if there aren't enough cold ones. Either way a
+ * thread that was moved in the last SCHED_MOVE_HOLDOFF hardclocks stays
+ * put, so threads don't ping-pong between cpus.
  */
 void
 thread_consider_migration(void)
 {
 	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
+	unsigned i, numcpus, now;
 	struct cpu *c;
 	struct threadlist victims;
 	struct thread *t;
 
+	/* An empty queue is never over its share; don't lock everyone's. */
+	if (runqueue_count(curcpu) == 0) {
+		return;
+	}
+
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
+		total_count += runqueue_count(c);
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			my_count = runqueue_count(c);
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	if (my_count <= one_share) {
 		return;
 	}
 
 	to_send = my_count - one_share;
+	now = curcpu->c_hardclocks;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
+	runqueue_pick_victims(curcpu, &victims, to_send, true, now);
+	runqueue_pick_victims(curcpu, &victims, to_send, false, now);
+	to_send = victims.tl_count;
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
@@ -893,7 +1969,7 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
+		while (runqueue_count(c) < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
 			/*
 			 * Ordinarily, curthread will not appear on
@@ -922,9 +1998,21 @@ thread_consider_migration(void)
 				to_send--;
 				continue;
 			}
+			/*
+			 * Likewise if it may not run on C. (It may
+			 * still be able to go to a later cpu, but we
+			 * don't go back round for it.)
+			 */
+			if (!thread_allowed(t, c)) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_set_cpu(t, c);
+			t->t_movedat = now;
+			curcpu->c_pushes++;
+			runqueue_add(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +2036,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			runqueue_add(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -957,6 +2045,118 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Print migration counters, and the migration rate since the last
+ * time this was called (or since boot).
+ */
+void
+thread_migration_stats(void)
+{
+	static unsigned last_total;
+	static time_t last_secs;
+	static uint32_t last_nsecs;
+	time_t now_secs, secs;
+	uint32_t now_nsecs, nsecs;
+	unsigned i, total, msecs;
+	struct cpu *c;
+
+	total = 0;
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u pushed, %u stolen\n",
+			c->c_number, c->c_pushes, c->c_steals);
+		total += c->c_pushes + c->c_steals;
+	}
+
+	fast_gettime(&now_secs, &now_nsecs);
+	if (last_secs == 0) {
+		/* First call; measure from boot. */
+		last_secs = now_secs - cpuarray_get(&allcpus, 0)->c_hardclocks / HZ;
+		last_nsecs = now_nsecs;
+	}
+	getinterval(last_secs, last_nsecs, now_secs, now_nsecs, &secs, &nsecs);
+	msecs = secs * 1000 + nsecs / 1000000;
+
+	kprintf("%u migrations in %u.%03u seconds", total - last_total,
+		msecs / 1000, msecs % 1000);
+	if (msecs > 0) {
+		kprintf(" (%u per second)",
+			(total - last_total) * 1000 / msecs);
+	}
+	kprintf("\n");
+
+	last_total = total;
+	last_secs = now_secs;
+	last_nsecs = now_nsecs;
+}
+
+/* Print a hardclock count as seconds, to a hundredth. */
+static
+void
+print_ticks(const char *label, unsigned ticks)
+{
+	kprintf("%s %u.%02us", label, ticks / HZ, (ticks % HZ) * 100 / HZ);
+}
+
+static
+void
+print_thread_stats(struct thread *t, const char *what)
+{
+	kprintf("    %-16s %-8s", t->t_name, what);
+	print_ticks(" run", t->t_runticks);
+	print_ticks(" wait", t->t_waitticks);
+	kprintf(" %u vol %u invol\n", t->t_nvcsw, t->t_nivcsw);
+}
+
+/*
+ * Print the scheduling accounting: for each cpu, how it spent its
+ * time and how contended its run queue lock has been, then the thread
+ * it's running and the threads waiting for it.
+ * (Sleeping threads aren't kept on any list we can find from here.)
+ */
+void
+thread_sched_stats(void)
+{
+	struct cpu *c;
+	struct threadlist *tl;
+	struct threadlistnode *tln;
+	unsigned i, level, busy, total;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+
+		spinlock_acquire(&c->c_runqueue_lock);
+		kprintf("cpu%u:", c->c_number);
+		print_ticks(" busy", c->c_busyticks);
+		print_ticks(" idle", c->c_idleticks);
+		busy = c->c_busyticks;
+		total = busy + c->c_idleticks;
+		/* Scale down so busy * 100 can't overflow. */
+		while (total > 0xffffffffU / 100) {
+			busy >>= 1;
+			total >>= 1;
+		}
+		if (total > 0) {
+			kprintf(" (%u%% busy)", busy * 100 / total);
+		}
+		kprintf(", %u switches\n", c->c_switches);
+		spinlock_printstats("    run queue lock", &c->c_runqueue_lock);
+
+		if (!c->c_isidle && c->c_curthread != NULL) {
+			print_thread_stats(c->c_curthread, "running");
+		}
+		for (level = 0; level <= SCHED_NLEVELS; level++) {
+			tl = level < SCHED_NLEVELS ?
+				&c->c_runqueue[level] : &c->c_sharequeue;
+			for (tln = tl->tl_head.tln_next; tln->tln_next != NULL;
+			     tln = tln->tln_next) {
+				print_thread_stats(tln->tln_self, "ready");
+			}
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1022,9 +2222,20 @@ wchan_unlock(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc)
 {
+	struct thread *cur = curthread;
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+	/*
+	 * Threads that block are (probably) interactive or I/O-bound,
+	 * so move them up a level and give them a fresh quantum.
+	 */
+	if (cur->t_priority > 0) {
+		cur->t_priority--;
+	}
+	cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+
 	thread_switch(S_SLEEP, wc);
 }
 
@@ -1078,18 +2289,36 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_release(&wc->wc_lock);
 
-	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
-	 */
-	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
-	}
+	thread_make_runnable_list(&list);
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move all the threads sleeping on one wait channel onto another. They
+ * stay asleep; when woken it'll be through TO. Used by cv_broadcast
+ * to send waiters straight to the lock's queue instead of waking them
+ * all to fight over it.
+ *
+ * The caller must hold FROM's lock, and channels must always be taken
+ * in the same order (for cv_broadcast: the cv's, then the lock's).
+ */
+void
+wchan_moveall(struct wchan *from, struct wchan *to)
+{
+	struct thread *t;
+
+	KASSERT(spinlock_do_i_hold(&from->wc_lock));
+	KASSERT(from != to);
+
+	spinlock_acquire(&to->wc_lock);
+	while ((t = threadlist_remhead(&from->wc_threads)) != NULL) {
+		t->t_wchan_name = to->wc_name;
+		threadlist_addtail(&to->wc_threads, t);
+	}
+	spinlock_release(&to->wc_lock);
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1108,6 +2337,114 @@ wchan_isempty(struct wchan *wc)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Timed sleep.
+ *
+ * Each cpu keeps a hierarchical timer wheel of threads sleeping until
+ * a given hardclock. Level 0 has one slot per hardclock; each slot of
+ * level 1 covers a whole turn of level 0, and so on. Every tick wakes
+ * exactly the threads in the current level 0 slot, all of which are
+ * due. Once per turn of a level, the next slot of the level above is
+ * emptied out and its threads spread over the level below. So both
+ * going to sleep and waking up are constant time, and nobody gets
+ * woken up before their time.
+ *
+ * A thread sleeps on the wheel of the cpu it's running on and wakes
+ * up there. Because the wheel only turns in hardclock, resolution is
+ * one tick.
+ */
+
+/*
+ * Sleep for at least TICKS hardclocks. As the current tick is already
+ * partly over, the wakeup is really TICKS+1 ticks from now; asking for
+ * 0 just yields.
+ */
+void
+thread_sleep_ticks(unsigned ticks)
+{
+	struct thread *cur = curthread;
+	struct cpu *c;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!cur->t_in_interrupt);
+
+	if (ticks == 0) {
+		thread_yield();
+		return;
+	}
+
+	/* Same as wchan_sleep. */
+	if (cur->t_priority > 0) {
+		cur->t_priority--;
+	}
+	cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+
+	/* Holding the timer lock keeps us on this cpu from here on. */
+	spinlock_acquire(&curcpu->c_timer_lock);
+	c = curcpu->c_self;
+	cur->t_wakeat = c->c_timer_now + ticks + 1;
+	c->c_timer_count++;
+	thread_switch(S_SLEEP, NULL);
+}
+
+/*
+ * Advance this cpu's timer wheel by one tick and wake up the threads
+ * that are now due. Called from hardclock.
+ */
+void
+thread_timer_tick(void)
+{
+	struct cpu *c;
+	struct threadlist *tl;
+	struct threadlist due;
+	struct thread *t;
+	unsigned level, slot;
+
+	/* Quick unlocked check; an idle wheel still has to keep time. */
+	c = curcpu->c_self;
+	if (c->c_timer_count == 0) {
+		c->c_timer_now++;
+		return;
+	}
+
+	threadlist_init(&due);
+
+	spinlock_acquire(&c->c_timer_lock);
+	c->c_timer_now++;
+
+	/*
+	 * Cascade: each time a level completes a turn, redistribute
+	 * the next slot of the level above.
+	 */
+	for (level = 1; level < TIMER_LEVELS; level++) {
+		if ((c->c_timer_now &
+		     ((1U << (level * TIMER_SLOTBITS)) - 1)) != 0) {
+			break;
+		}
+		slot = (c->c_timer_now >> (level * TIMER_SLOTBITS)) &
+			(TIMER_SLOTS - 1);
+		tl = &c->c_timers[level][slot];
+		while ((t = threadlist_remhead(tl)) != NULL) {
+			timer_insert(c, t);
+		}
+	}
+
+	tl = &c->c_timers[0][c->c_timer_now & (TIMER_SLOTS - 1)];
+	while ((t = threadlist_remhead(tl)) != NULL) {
+		KASSERT(t->t_wakeat == c->c_timer_now);
+		c->c_timer_count--;
+		threadlist_addtail(&due, t);
+	}
+	spinlock_release(&c->c_timer_lock);
+
+	/* Wake them up with the lock released, as wchan_wakeall does. */
+	thread_make_runnable_list(&due);
+
+	threadlist_cleanup(&due);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Machine-independent IPI handling
  */
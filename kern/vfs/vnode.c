@@ -33,6 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <atomic.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -77,23 +78,52 @@ vnode_cleanup(struct vnode *vn)
 /*
  * Increment refcount.
  * Called by VOP_INCREF.
+ *
+ * The caller either has a reference already, or (in the filesystem's
+ * lookup code) holds the biglock, so the count can't be on its way to
+ * zero and this needn't take the biglock itself.
  */
 void
 vnode_incref(struct vnode *vn)
 {
+	int old;
+
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
+	old = atomic_fetchadd(&vn->vn_refcount, 1);
+	KASSERT(old > 0);
+}
 
-	vn->vn_refcount++;
+/*
+ * Drop a reference, unless it's the last one. Returns true if it
+ * dropped it.
+ */
+static
+bool
+vnode_tryderef(struct vnode *vn)
+{
+	int old;
 
-	vfs_biglock_release();
+	while (1) {
+		old = vn->vn_refcount;
+		KASSERT(old > 0);
+		if (old == 1) {
+			return false;
+		}
+		if (atomic_cas(&vn->vn_refcount, old, old - 1) == old) {
+			return true;
+		}
+	}
 }
 
 /*
  * Decrement refcount.
  * Called by VOP_DECREF.
  * Calls VOP_RECLAIM if the refcount hits zero.
+ *
+ * Only the last reference needs the biglock, which keeps lookups
+ * from picking the vnode up again while it's reclaimed. Check again
+ * once we have it, in case a lookup got in first.
  */
 void
 vnode_decref(struct vnode *vn)
@@ -102,13 +132,13 @@ vnode_decref(struct vnode *vn)
 
 	KASSERT(vn != NULL);
 
+	if (vnode_tryderef(vn)) {
+		return;
+	}
+
 	vfs_biglock_acquire();
 
-	KASSERT(vn->vn_refcount>0);
-	if (vn->vn_refcount>1) {
-		vn->vn_refcount--;
-	}
-	else {
+	if (!vnode_tryderef(vn)) {
 		result = VOP_RECLAIM(vn);
 		if (result != 0 && result != EBUSY) {
 			// XXX: lame.
@@ -345,6 +345,8 @@ kheap_printstats(void)
 	}
 
 	spinlock_release(&kmalloc_spinlock);
+
+	spinlock_printstats("kmalloc lock", &kmalloc_spinlock);
 }
 
 ////////////////////////////////////////
@@ -3,11 +3,11 @@
 /* belongs in kern/vm/uw-vmstats.c */
 
 /* NOTE !!!!!! WARNING !!!!!
- * All of the functions whose names begin with '_'
- * assume that atomicity is ensured elsewhere
- * (i.e., outside of these routines) by acquiring stats_lock.
- * All of the functions whose names do not begin
- * with '_' ensure atomicity locally.
+ * The counters are only ever changed with atomic operations, so
+ * vmstats_inc and _vmstats_inc are the same and need no lock; the
+ * underscore version is kept for code that already holds stats_lock.
+ * stats_lock only covers (re)initializing the counters: _vmstats_init
+ * assumes the caller holds it, and vmstats_init takes it.
  */
 
 #include <types.h>
@@ -15,9 +15,10 @@
 #include <synch.h>
 #include <spl.h>
 #include <uw-vmstats.h>
+#include <atomic.h>
 
 /* Counters for tracking statistics */
-static unsigned int stats_counts[VMSTAT_COUNT];
+static volatile int stats_counts[VMSTAT_COUNT];
 
 struct spinlock stats_lock = SPINLOCK_INITIALIZER;
 
@@ -38,12 +39,12 @@ static const char *stats_names[] = {
 
 /* ---------------------------------------------------------------------- */
 /* Assumes vmstat_init has already been called */
+/* These are bumped on every TLB fault, so don't take a lock for it */
 void
 vmstats_inc(unsigned int index)
 {
-    spinlock_acquire(&stats_lock);
-      _vmstats_inc(index);
-    spinlock_release(&stats_lock);
+  KASSERT(index < VMSTAT_COUNT);
+  atomic_fetchadd(&stats_counts[index], 1);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -61,11 +62,12 @@ vmstats_init(void)
 }
 
 /* ---------------------------------------------------------------------- */
+/* Same as vmstats_inc; a plain ++ here would lose counts racing with it */
 void
 _vmstats_inc(unsigned int index)
 {
   KASSERT(index < VMSTAT_COUNT);
-  stats_counts[index]++;
+  atomic_fetchadd(&stats_counts[index], 1);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -306,6 +306,7 @@ docommand(char *buf)
 	char *args[NARG_MAX + 1];
 	int nargs, i;
 	char *s;
+	const char *msg;
 	pid_t pid;
 	int status;
 	int bg=0;
@@ -354,16 +355,31 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	/*
+	 * The child only execs, so it can borrow our address space
+	 * rather than have it copied.
+	 */
+	pid = vfork();
 	switch (pid) {
 		case -1:
 			/* error */
-			warn("fork");
+			warn("vfork");
 			return _MKWAIT_EXIT(255);
 		case 0:
 			/* child */
 			execv(args[0], args);
-			warn("%s", args[0]);
+			/*
+			 * We're still in the parent's address space,
+			 * so stay out of stdio (warn would write
+			 * through the parent's buffers) and complain
+			 * with write().
+			 */
+			msg = strerror(errno);
+			write(STDERR_FILENO, "sh: ", 4);
+			write(STDERR_FILENO, args[0], strlen(args[0]));
+			write(STDERR_FILENO, ": ", 2);
+			write(STDERR_FILENO, msg, strlen(msg));
+			write(STDERR_FILENO, "\n", 1);
 			/*
 			 * Use _exit() instead of exit() in the child
 			 * process to avoid calling atexit() functions,
@@ -0,0 +1,24 @@
+/*
+ * Atomic operations on 32-bit words.
+ */
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Same interface as the kernel's <atomic.h>:
+ *
+ * atomic_cas	   If *P is OLD, set it to NEW. Returns the value *P had
+ *		   before, so the store happened iff that equals OLD.
+ * atomic_fetchadd Add DELTA to *P. Returns the value *P had before.
+ * atomic_swap	   Set *P to VAL. Returns the value *P had before.
+ *
+ * These are safe against other threads or processes sharing the
+ * memory, on this cpu or any other.
+ */
+
+int atomic_cas(volatile int *p, int old, int new);
+int atomic_fetchadd(volatile int *p, int delta);
+int atomic_swap(volatile int *p, int val);
+
+#endif /* _ATOMIC_H_ */
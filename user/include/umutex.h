@@ -0,0 +1,28 @@
+/*
+ * User-level mutexes.
+ */
+
+#ifndef _UMUTEX_H_
+#define _UMUTEX_H_
+
+/*
+ * A mutex for threads sharing an address space. Taking or releasing
+ * a mutex nobody else wants is a single atomic operation in user
+ * space; only when there's contention do we go into the kernel, with
+ * futex_wait and futex_wake, to sleep or to wake a sleeper.
+ *
+ * um_state is 0 if unlocked, 1 if locked, and 2 if locked and there
+ * may be threads waiting.
+ */
+struct umutex {
+	volatile int um_state;
+};
+
+#define UMUTEX_INITIALIZER	{ 0 }
+
+void umutex_init(struct umutex *m);
+void umutex_lock(struct umutex *m);
+int umutex_trylock(struct umutex *m);	/* returns 0 if it got the lock */
+void umutex_unlock(struct umutex *m);
+
+#endif /* _UMUTEX_H_ */
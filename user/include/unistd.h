@@ -44,6 +44,7 @@
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/resource.h>	/* after kern/time.h */
 
 
 /*
@@ -118,6 +119,7 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+pid_t vfork(void);
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -157,11 +159,19 @@ int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
+/* Local extensions. */
+int setshare(int share);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int getrusage(int who, struct rusage *usage);
+int setaffinity(unsigned mask);		/* for the calling thread */
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int num);
+
 /*
  * These are not themselves system calls, but wrapper routines in libc.
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+time_t time(time_t *seconds);			/* reads the time page */
 
 #endif /* _UNISTD_H_ */
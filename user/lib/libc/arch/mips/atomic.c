@@ -0,0 +1,71 @@
+/*
+ * MIPS atomic operations for user programs, using LL/SC. These are
+ * the same as the kernel's versions in <machine/atomic.h>.
+ */
+
+#include <atomic.h>
+
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   give up if x != old */
+		"move %1, %4;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+int
+atomic_fetchadd(volatile int *p, int delta)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return x;
+}
+
+int
+atomic_swap(volatile int *p, int val)
+{
+	int x;
+	int y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = val */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (val)
+		: "memory");
+	return x;
+}
@@ -74,14 +74,19 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
-	pid = fork();
+	/* vfork, since the child does nothing but exec */
+	pid = vfork();
 	switch (pid) {
 	    case -1:
 		return -1;
 	    case 0:
 		/* child */
 		execv(argv[0], argv);
-		/* exec only returns if it fails */
+		/*
+		 * exec only returns if it fails. We're still in the
+		 * parent's address space, so nothing but _exit: no
+		 * stdio, no atexit handlers.
+		 */
 		_exit(255);
 	    default:
 		/* parent */
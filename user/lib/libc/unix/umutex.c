@@ -0,0 +1,71 @@
+/*
+ * User-level mutexes. See <umutex.h>.
+ *
+ * This is the usual three-state futex mutex: the uncontended lock and
+ * unlock are one atomic instruction each, and the kernel is entered
+ * only when some thread actually has to wait.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <atomic.h>
+#include <umutex.h>
+
+#define UM_UNLOCKED	0
+#define UM_LOCKED	1
+#define UM_CONTENDED	2
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = UM_UNLOCKED;
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	if (atomic_cas(&m->um_state, UM_UNLOCKED, UM_LOCKED) != UM_UNLOCKED) {
+		errno = EAGAIN;
+		return -1;
+	}
+	return 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	int state;
+
+	/* Fast path: unlocked, so just take it. */
+	state = atomic_cas(&m->um_state, UM_UNLOCKED, UM_LOCKED);
+	if (state == UM_UNLOCKED) {
+		return;
+	}
+
+	/*
+	 * Slow path: mark the mutex contended, so whoever unlocks it
+	 * knows to wake someone, and sleep until it's free. If the swap
+	 * finds it unlocked we've got it (marked contended, which costs
+	 * at worst one unneeded wake). futex_wait returns straight away
+	 * if the state changed in the meantime.
+	 */
+	if (state != UM_CONTENDED) {
+		state = atomic_swap(&m->um_state, UM_CONTENDED);
+	}
+	while (state != UM_UNLOCKED) {
+		futex_wait(&m->um_state, UM_CONTENDED);
+		state = atomic_swap(&m->um_state, UM_CONTENDED);
+	}
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	/* Fast path: nobody waiting. */
+	if (atomic_fetchadd(&m->um_state, -1) == UM_LOCKED) {
+		return;
+	}
+
+	m->um_state = UM_UNLOCKED;
+	futex_wake(&m->um_state, 1);
+}
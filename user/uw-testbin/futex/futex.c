@@ -0,0 +1,69 @@
+/*
+ * futex
+ *
+ * 	check futex_wait/futex_wake and the user mutexes built on them
+ *
+ *   A single thread can't block on a futex without hanging, so this
+ *   checks the cases that mustn't sleep: futex_wait returns EAGAIN if
+ *   the word has changed, futex_wake with nobody waiting wakes nobody,
+ *   bad addresses are rejected, and a mutex nobody else wants goes
+ *   through its states without entering the kernel at all.
+ *
+ *   relies on futex_wait and futex_wake
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+#include <umutex.h>
+
+static volatile int word = 5;
+static int bad = 0;
+
+static
+void
+check(int ok, const char *what)
+{
+  if (!ok) {
+    printf("futex: FAILED: %s\n", what);
+    bad = 1;
+  }
+}
+
+int
+main()
+{
+  struct umutex m = UMUTEX_INITIALIZER;
+  int r;
+
+  r = futex_wait(&word, 4);
+  check(r == -1 && errno == EAGAIN, "wait on changed word gives EAGAIN");
+
+  r = futex_wake(&word, 1);
+  check(r == 0, "wake with no waiters wakes nobody");
+
+  r = futex_wait((volatile int *)((char *)&word + 1), 5);
+  check(r == -1 && errno == EINVAL, "misaligned wait gives EINVAL");
+
+  r = futex_wait((volatile int *)0x80000000, 0);
+  check(r == -1 && errno == EFAULT, "kernel address gives EFAULT");
+
+  r = futex_wake(&word, -1);
+  check(r == -1 && errno == EINVAL, "negative wake count gives EINVAL");
+
+  umutex_lock(&m);
+  check(m.um_state == 1, "uncontended lock leaves state 1");
+  check(umutex_trylock(&m) == -1, "trylock of held mutex fails");
+  umutex_unlock(&m);
+  check(m.um_state == 0, "uncontended unlock leaves state 0");
+  check(umutex_trylock(&m) == 0, "trylock of free mutex succeeds");
+  umutex_unlock(&m);
+
+  if (bad) {
+    errx(1, "some checks failed");
+  }
+  printf("futex: passed\n");
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * naptime
+ *
+ * 	check that nanosleep sleeps about as long as asked
+ *
+ *   Takes NNAPS short naps of each of a few lengths, timing each batch
+ *   with __time, and prints how long a nap took on average. Every nap
+ *   must last at least as long as requested; beyond that it should
+ *   overshoot by no more than a couple of clock ticks.
+ *
+ *   relies on nanosleep and __time
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NNAPS     20
+/* allowed average overshoot, in microseconds (two ticks at HZ=100) */
+#define TOLERANCE 20000
+
+static const long naplengths[] = { 1000, 10000, 25000, 100000 }; /* usec */
+#define NLENGTHS (sizeof(naplengths) / sizeof(naplengths[0]))
+
+/* microseconds since some fixed point */
+static
+unsigned long
+now_us(void)
+{
+  time_t secs;
+  unsigned long nsecs;
+
+  __time(&secs, &nsecs);
+  return (unsigned long)secs * 1000000 + nsecs / 1000;
+}
+
+int
+main()
+{
+  struct timespec ts;
+  unsigned long start, each, total;
+  unsigned i, j;
+  int bad = 0;
+
+  for (i=0; i<NLENGTHS; i++) {
+    ts.tv_sec = 0;
+    ts.tv_nsec = naplengths[i] * 1000;
+    total = 0;
+    for (j=0; j<NNAPS; j++) {
+      start = now_us();
+      if (nanosleep(&ts, NULL)) {
+        err(1, "nanosleep");
+      }
+      each = now_us() - start;
+      if (each < (unsigned long)naplengths[i]) {
+        printf("naptime: asked for %ld us, slept only %lu us\n",
+               naplengths[i], each);
+        bad = 1;
+      }
+      total += each;
+    }
+    printf("naptime: %ld us naps took %lu us on average\n",
+           naplengths[i], total / NNAPS);
+    if (total / NNAPS > (unsigned long)naplengths[i] + TOLERANCE) {
+      printf("naptime: overslept\n");
+      bad = 1;
+    }
+  }
+
+  printf("naptime: %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}
@@ -0,0 +1,72 @@
+/*
+ * nohang
+ *
+ * 	check waitpid with WNOHANG
+ *
+ *   Forks a child that naps for a moment before exiting. While it's
+ *   napping, waitpid(WNOHANG) must return 0 straight away; after a
+ *   blocking waitpid has collected it, waiting for it again must fail.
+ *
+ *   relies on fork, nanosleep, _exit, and waitpid
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#define NAP_NSEC  200000000	/* 0.2 seconds */
+
+int
+main()
+{
+  struct timespec ts;
+  pid_t pid, result;
+  int status;
+  int bad = 0;
+
+  pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  }
+  if (pid == 0) {
+    ts.tv_sec = 0;
+    ts.tv_nsec = NAP_NSEC;
+    nanosleep(&ts, NULL);
+    _exit(7);
+  }
+
+  result = waitpid(pid, &status, WNOHANG);
+  if (result != 0) {
+    printf("nohang: WNOHANG on a running child returned %d\n",
+           (int)result);
+    bad = 1;
+  }
+
+  result = waitpid(pid, &status, 0);
+  if (result != pid) {
+    err(1, "waitpid");
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 7) {
+    printf("nohang: bad exit status 0x%x\n", status);
+    bad = 1;
+  }
+
+  result = waitpid(pid, &status, WNOHANG);
+  if (result >= 0) {
+    printf("nohang: waiting for a reaped child returned %d\n",
+           (int)result);
+    bad = 1;
+  }
+
+  result = waitpid(pid, &status, WNOHANG | WUNTRACED);
+  if (result >= 0 || errno != EINVAL) {
+    printf("nohang: unsupported option was not rejected\n");
+    bad = 1;
+  }
+
+  printf("nohang: %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}
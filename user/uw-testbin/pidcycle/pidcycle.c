@@ -0,0 +1,59 @@
+/*
+ * pidcycle
+ *
+ * 	check that PIDs are recycled
+ *
+ *   Forks and waits for more children, one at a time, than there are
+ *   PIDs, so it only finishes if reaped PIDs get reused. Also checks
+ *   that a reaped child's PID isn't handed straight to the next child,
+ *   and that every exit status comes back intact.
+ *
+ *   relies on fork, _exit, and waitpid
+ *
+ */
+
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <sys/wait.h>
+
+#define NFORKS  (PID_MAX + 1000)
+
+int
+main()
+{
+  pid_t pid, lastpid = -1;
+  int status;
+  unsigned i;
+  int bad = 0;
+
+  for (i=0; i<NFORKS; i++) {
+    pid = fork();
+    if (pid < 0) {
+      err(1, "fork %u", i);
+    }
+    if (pid == 0) {
+      _exit(i % 200);
+    }
+    if (pid == lastpid) {
+      printf("pidcycle: PID %d reused straight away\n", (int)pid);
+      bad = 1;
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+      err(1, "waitpid %d", (int)pid);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != (int)(i % 200)) {
+      printf("pidcycle: child %u: bad exit status 0x%x\n", i, status);
+      bad = 1;
+    }
+    lastpid = pid;
+    if (i % 5000 == 0) {
+      printf("pidcycle: %u forks, last PID %d\n", i, (int)pid);
+    }
+  }
+
+  printf("pidcycle: %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}
@@ -0,0 +1,198 @@
+/*
+ * sharehog
+ *
+ * 	check that proportional-share scheduling splits the CPU by weight
+ *
+ *   First forks an x, a y and a z hog (like xhog/yhog/zhog) with
+ *   shares 1, 2 and 4. Each one spins for RUNSECS seconds, counting
+ *   batches of BATCH loop iterations, and reports the count in its
+ *   exit status. It only looks at the clock between batches and
+ *   prints nothing until it's done, so system calls and console output
+ *   don't disturb the split being measured. With the hogs competing
+ *   for one CPU the counts should come out close to 1:2:4.
+ *
+ *   Then it runs an ordinary timesharing t hog against an s hog with
+ *   share MIXSHARE. All the timesharing threads together hold 100
+ *   shares, so that split should be 4:1. Each hog also reports how
+ *   often it was preempted. The s hog gives way after every tick it
+ *   runs, and the t hog should only be preempted when the s hog is
+ *   due, so about as often; a t hog preempted on every tick is a bug.
+ *
+ *   Run this on a single-CPU configuration.
+ *
+ *   relies on fork, _exit, waitpid, __time, setshare and getrusage
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NHOGS     3
+#define RUNSECS   5
+/* allowed deviation from the ideal split, in percent of the total */
+#define TOLERANCE 5
+/* loop iterations between looks at the clock */
+#define BATCH     10000
+
+/* share of the s hog in the mixed run */
+#define MIXSHARE  25
+
+/*
+ * A hog's exit status holds its batch count in the low COUNTBITS
+ * bits and its involuntary context switch count above that. Both
+ * are capped so the status stays positive.
+ */
+#define COUNTBITS 15
+#define COUNTMAX  ((1 << COUNTBITS) - 1)
+#define SWITCHMAX ((1 << 14) - 1)
+
+static const char hogchars[NHOGS] = { 'x', 'y', 'z' };
+static const int hogshares[NHOGS] = { 1, 2, 4 };
+
+/* milliseconds since some fixed point */
+static
+unsigned long
+now_ms(void)
+{
+  time_t secs;
+  unsigned long nsecs;
+
+  __time(&secs, &nsecs);
+  return (unsigned long)secs * 1000 + nsecs / 1000000;
+}
+
+/* spin for RUNSECS seconds with share SHARE (0 for timesharing) */
+static
+void
+hog(char name, int share)
+{
+  struct rusage ru;
+  unsigned long start, count, switches;
+  volatile int i;
+
+  if (share > 0 && setshare(share)) {
+    err(1, "setshare");
+  }
+
+  count = 0;
+  start = now_ms();
+  while (now_ms() - start < RUNSECS * 1000) {
+    for (i=0; i<BATCH; i++)
+      ;
+    count++;
+  }
+
+  if (getrusage(RUSAGE_SELF, &ru)) {
+    err(1, "getrusage");
+  }
+  switches = ru.ru_nivcsw;
+  if (count > COUNTMAX) {
+    count = COUNTMAX;
+  }
+  if (switches > SWITCHMAX) {
+    switches = SWITCHMAX;
+  }
+  putchar(name);
+  _exit((switches << COUNTBITS) | count);
+}
+
+/*
+ * Run NUM hogs with the given names and shares at once, and collect
+ * their batch and switch counts.
+ */
+static
+void
+runhogs(int num, const char *names, const int *shares,
+	unsigned long *counts, unsigned long *switches)
+{
+  pid_t pids[NHOGS];
+  int status, i;
+
+  for (i=0; i<num; i++) {
+    pids[i] = fork();
+    if (pids[i] < 0) {
+      err(1, "fork");
+    }
+    if (pids[i] == 0) {
+      hog(names[i], shares[i]);
+    }
+  }
+
+  for (i=0; i<num; i++) {
+    if (waitpid(pids[i], &status, 0) < 0) {
+      err(1, "waitpid");
+    }
+    counts[i] = WEXITSTATUS(status) & COUNTMAX;
+    switches[i] = WEXITSTATUS(status) >> COUNTBITS;
+  }
+  printf("\n");
+}
+
+/*
+ * Check NUM hogs' batch counts against the split WANT (in percent).
+ * Returns nonzero if it's off.
+ */
+static
+int
+checksplit(int num, const char *names, const int *shares, const int *want,
+	   const unsigned long *counts, const unsigned long *switches)
+{
+  unsigned long total;
+  int i, got, failed;
+
+  total = 0;
+  for (i=0; i<num; i++) {
+    total += counts[i];
+  }
+  if (total == 0) {
+    errx(1, "hogs made no progress");
+  }
+
+  failed = 0;
+  for (i=0; i<num; i++) {
+    got = (int)(counts[i] * 100 / total);
+    printf("%chog: share %d, %lu batches, %lu preemptions, "
+	   "%d%% of CPU (want %d%%)\n",
+	   names[i], shares[i], counts[i], switches[i], got, want[i]);
+    if (got < want[i] - TOLERANCE || got > want[i] + TOLERANCE) {
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+int
+main()
+{
+  static const char mixnames[2] = { 't', 's' };
+  static const int mixshares[2] = { 0, MIXSHARE };
+  static const int mixwant[2] = { 80, 20 };
+  unsigned long counts[NHOGS], switches[NHOGS];
+  int want[NHOGS];
+  int i, totalshares, failed;
+
+  totalshares = 0;
+  for (i=0; i<NHOGS; i++) {
+    totalshares += hogshares[i];
+  }
+  for (i=0; i<NHOGS; i++) {
+    want[i] = hogshares[i] * 100 / totalshares;
+  }
+
+  runhogs(NHOGS, hogchars, hogshares, counts, switches);
+  failed = checksplit(NHOGS, hogchars, hogshares, want, counts, switches);
+
+  runhogs(2, mixnames, mixshares, counts, switches);
+  if (checksplit(2, mixnames, mixshares, mixwant, counts, switches)) {
+    failed = 1;
+  }
+  /* allow some slack for ticks lost to the shell and the parent */
+  if (switches[0] > 2 * switches[1] + 10) {
+    printf("thog was preempted more than twice as often as shog\n");
+    failed = 1;
+  }
+
+  printf("sharehog: %s\n", failed ? "FAILED" : "passed");
+  return failed;
+}
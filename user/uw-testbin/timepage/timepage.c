@@ -0,0 +1,74 @@
+/*
+ * timepage
+ *
+ * 	check that time() agrees with the __time system call
+ *
+ *   time() reads the shared time page instead of trapping into the
+ *   kernel. Over a few seconds of calls, its answer must never be more
+ *   than a second away from what __time says. Also times a batch of
+ *   each, to show what skipping the system call saves.
+ *
+ *   relies on __time
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+
+#define NCALLS    20000
+#define NROUNDS   5
+
+/* microseconds since some fixed point */
+static
+unsigned long
+now_us(void)
+{
+  time_t secs;
+  unsigned long nsecs;
+
+  __time(&secs, &nsecs);
+  return (unsigned long)secs * 1000000 + nsecs / 1000;
+}
+
+int
+main()
+{
+  time_t slow, fast, fast2;
+  unsigned long nsecs, start, fast_us, slow_us;
+  unsigned i, j;
+  int bad = 0;
+
+  for (i=0; i<NROUNDS; i++) {
+    for (j=0; j<NCALLS; j++) {
+      fast = time(&fast2);
+      __time(&slow, &nsecs);
+      if (fast != fast2) {
+        printf("timepage: time() returned %d but stored %d\n",
+               (int)fast, (int)fast2);
+        bad = 1;
+      }
+      if (fast > slow + 1 || slow > fast + 1) {
+        printf("timepage: time() says %d, __time says %d\n",
+               (int)fast, (int)slow);
+        bad = 1;
+      }
+    }
+  }
+
+  start = now_us();
+  for (j=0; j<NCALLS; j++) {
+    (void)time(NULL);
+  }
+  fast_us = now_us() - start;
+
+  start = now_us();
+  for (j=0; j<NCALLS; j++) {
+    (void)__time(&slow, &nsecs);
+  }
+  slow_us = now_us() - start;
+
+  printf("timepage: %d calls: time() %lu us, __time %lu us\n",
+         NCALLS, fast_us, slow_us);
+  printf("timepage: %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}
@@ -0,0 +1,72 @@
+/*
+ * vforktest
+ *
+ * 	check that vfork shares the address space and suspends the parent
+ *
+ *   The child sets a global and exits; since it's using the parent's
+ *   memory, the parent must see the new value as soon as vfork
+ *   returns. Then a second child execs /bin/true, and the parent
+ *   checks that both exit statuses come back.
+ *
+ *   relies on vfork, execv, _exit, and waitpid
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include <sys/wait.h>
+
+static volatile int shared;
+
+int
+main()
+{
+  char *args[2];
+  pid_t pid;
+  int status;
+  int bad = 0;
+
+  shared = 0;
+  pid = vfork();
+  if (pid < 0) {
+    err(1, "vfork");
+  }
+  if (pid == 0) {
+    shared = 1;
+    _exit(5);
+  }
+  /* the child has exited by now, and wrote to our memory */
+  if (shared != 1) {
+    printf("vforktest: child's write not seen\n");
+    bad = 1;
+  }
+  if (waitpid(pid, &status, 0) != pid) {
+    err(1, "waitpid");
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 5) {
+    printf("vforktest: bad exit status 0x%x\n", status);
+    bad = 1;
+  }
+
+  args[0] = (char *)"/bin/true";
+  args[1] = NULL;
+  pid = vfork();
+  if (pid < 0) {
+    err(1, "vfork");
+  }
+  if (pid == 0) {
+    execv(args[0], args);
+    _exit(255);
+  }
+  if (waitpid(pid, &status, 0) != pid) {
+    err(1, "waitpid");
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("vforktest: %s: bad exit status 0x%x\n", args[0], status);
+    bad = 1;
+  }
+
+  printf("vforktest: %s\n", bad ? "FAILED" : "passed");
+  return bad;
+}